@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "flights.h"
+
+// Benchmark of the engine on a dataset file, one CSV line per measurement on stdout
+// Usage: bench FILE [REPEAT]
+// Every measurement is run REPEAT times and the median is reported, so regressions show up in a diff of two runs
+
+static const char *sortNames[] = {"", "flight", "origin", "destination", "capacity", "departure", "price", "stops"};
+
+double now(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+int compareDoubles(const void *a, const void *b){
+    return (*(const double *)a > *(const double *)b) - (*(const double *)a < *(const double *)b);
+}
+
+double median(double times[], int n){
+    qsort(times, n, sizeof(double), compareDoubles);
+    return times[n / 2];
+}
+
+void report(const char *benchmark, const char *argument, int rows, long matches, double ms){
+    printf("%s,%s,%d,%ld,%.3f\n", benchmark, argument, rows, matches, ms);
+    fflush(stdout);
+}
+
+// Parse every line of the file without storing it, the cost of validating the file on its own
+long validateOnly(const char *path){
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0){
+        perror("Error Opening File");
+        exit(EXIT_FAILURE);
+    }
+    long lines = 0;
+    if (st.st_size > 0){
+        const char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED){
+            perror("Error Mapping File");
+            exit(EXIT_FAILURE);
+        }
+        const char *p = memchr(data, '\n', st.st_size), *end = data + st.st_size;
+        dataSet record;
+        initCharClass();
+        while (p != NULL && ++p < end){
+            const char *lineEnd = memchr(p, '\n', end - p);
+            if (lineEnd == NULL)
+                lineEnd = end;
+            if (parseRecord(p, lineEnd, &record) != PARSE_OK){
+                fprintf(stderr, "Error: format error in %s\n", path);
+                exit(EXIT_FAILURE);
+            }
+            lines++;
+            p = lineEnd;
+        }
+        munmap((void *)data, st.st_size);
+    }
+    close(fd);
+    return lines;
+}
+
+int main(int argc, char *argv[]){
+    if (argc < 2){
+        fprintf(stderr, "Usage: %s FILE [REPEAT]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    int repeat = argc > 2 ? atoi(argv[2]) : 3;
+    if (repeat < 1)
+        repeat = 1;
+    double *times = (double *)malloc(repeat * sizeof(double));
+    long matches = 0;
+    flightDB db;
+
+    printf("benchmark,argument,rows,matches,ms\n");
+
+    for (int r = 0; r < repeat; r++){
+        double start = now();
+        matches = validateOnly(argv[1]);
+        times[r] = now() - start;
+    }
+    report("validate", "", (int)matches, matches, median(times, repeat));
+
+    for (int r = 0; r < repeat; r++){
+        FILE *fp = fopen(argv[1], "r");
+        if (!fp){
+            perror("Error Opening File");
+            exit(EXIT_FAILURE);
+        }
+        if (r > 0)
+            freeDB(&db);
+        initDB(&db);
+        double start = now();
+        loadFile(fp, &db);
+        times[r] = now() - start;
+        fclose(fp);
+    }
+    // FLIGHTS_THREADS sets how many cores loading uses, runs with different values show how it scales
+    char threads[32];
+    snprintf(threads, sizeof(threads), "threads=%d", workerCount());
+    report("load", threads, db.numRows, db.numRows, median(times, repeat));
+
+    // Every sort starts from the file order, numbering the rows again drops the sorted views so nothing is reused
+    int *fileOrder = (int *)malloc((db.numRows > 0 ? db.numRows : 1) * sizeof(int));
+    orderRows(&db, fileOrder);
+    for (int option = 1; option <= 7; option++){
+        for (int r = 0; r < repeat; r++){
+            buildOrder(&db, fileOrder, db.numRows);
+            numberRows(&db);
+            double start = now();
+            sortDB(&db, option);
+            times[r] = now() - start;
+        }
+        report("sort", sortNames[option], db.numRows, db.numRows, median(times, repeat));
+    }
+    // Going back to an attribute sorted before copies its view, the view is built before the timing starts
+    // and switching between two attributes keeps both views among the SORT_VIEWS most recently used
+    for (int option = 1; option <= 7; option++){
+        sortDB(&db, option);
+        for (int r = 0; r < repeat; r++){
+            sortDB(&db, option % 7 + 1);
+            double start = now();
+            sortDB(&db, option);
+            times[r] = now() - start;
+        }
+        report("sort_view", sortNames[option], db.numRows, db.numRows, median(times, repeat));
+    }
+    // The string and the numeric sort again on 1, 2, 4... threads up to the number of cores
+    int cores = workerCount();
+    for (int threads = 1; ; threads = threads * 2 < cores ? threads * 2 : cores){
+        setWorkerCount(threads);
+        for (int option = 1; option <= 6; option += 5){
+            for (int r = 0; r < repeat; r++){
+                buildOrder(&db, fileOrder, db.numRows);
+                numberRows(&db);
+                double start = now();
+                sortDB(&db, option);
+                times[r] = now() - start;
+            }
+            char argument[32];
+            snprintf(argument, sizeof(argument), "%s threads=%d", sortNames[option], threads);
+            report("sort_threads", argument, db.numRows, db.numRows, median(times, repeat));
+        }
+        if (threads == cores)
+            break;
+    }
+    setWorkerCount(cores);
+    buildOrder(&db, fileOrder, db.numRows);
+    numberRows(&db);
+
+    // Queries are taken from rows of the file so that they match something at every size
+    if (db.numRows > 0){
+        int row = fileOrder[db.numRows / 2];
+        searchResult result = {0};
+        char argument[100], origin[5], destination[5];
+        unpackCode(db.origin[row], origin);
+        unpackCode(db.destination[row], destination);
+
+        // Flight numbers of one and two characters scan the distinct keys of the hash index, three or more use the trigram index
+        // Airport codes of any length are matched against the distinct codes of the route index and gather their posting lists
+        for (int option = 1; option <= 3; option++){
+            const char *field = option == 1 ? db.flightNumber[row] : (option == 2 ? origin : destination);
+            int length = strlen(field);
+            for (int q = 1; q <= length; q = q < 3 ? q + 1 : length){
+                char query[20];
+                snprintf(query, sizeof(query), "%.*s", q, field);
+                for (int r = 0; r < repeat; r++){
+                    double start = now();
+                    matches = searchDB(&db, query, &result, option);
+                    times[r] = now() - start;
+                }
+                snprintf(argument, sizeof(argument), "%s=%s", sortNames[option], query);
+                report("search", argument, db.numRows, matches, median(times, repeat));
+                if (q == length)
+                    break;
+            }
+        }
+
+        for (int r = 0; r < repeat; r++){
+            double start = now();
+            matches = searchExactDB(&db, db.flightNumber[row], &result);
+            times[r] = now() - start;
+        }
+        snprintf(argument, sizeof(argument), "exact=%s", db.flightNumber[row]);
+        report("search", argument, db.numRows, matches, median(times, repeat));
+
+        for (int r = 0; r < repeat; r++){
+            double start = now();
+            matches = searchRouteDB(&db, origin, destination, &result);
+            times[r] = now() - start;
+        }
+        snprintf(argument, sizeof(argument), "route=%s %s", origin, destination);
+        report("search", argument, db.numRows, matches, median(times, repeat));
+
+        // Queries, one served by the route index and two that scan the columns
+        char queries[3][100];
+        snprintf(queries[0], sizeof(queries[0]), "origin=%s AND stops=0 AND price<300 ORDER BY departure LIMIT 50", origin);
+        snprintf(queries[1], sizeof(queries[1]), "price<300 AND capacity>=200");
+        snprintf(queries[2], sizeof(queries[2]), "(origin=%s OR destination=%s) AND departure>=0700", origin, origin);
+        for (int i = 0; i < 3; i++){
+            query q;
+            parseQuery(queries[i], &q);
+            for (int r = 0; r < repeat; r++){
+                double start = now();
+                matches = queryDB(&db, &q, &result);
+                times[r] = now() - start;
+            }
+            report("query", queries[i], db.numRows, matches, median(times, repeat));
+        }
+
+        // Equality scan of the origin column with the widest kernel the processor runs, FLIGHTS_SIMD=sse2 or scalar times the others
+        unsigned long long *bits = (unsigned long long *)malloc((db.numSlots / 64 + 1) * sizeof(unsigned long long));
+        for (int r = 0; r < repeat; r++){
+            double start = now();
+            matchCodes(db.origin, db.numSlots, db.origin[row], bits);
+            times[r] = now() - start;
+        }
+        matches = 0;
+        for (int w = 0; w < (db.numSlots + 63) / 64; w++)
+            matches += __builtin_popcountll(bits[w]);
+        free(bits);
+        snprintf(argument, sizeof(argument), "origin=%s %s", origin, codeKernel());
+        report("scan_codes", argument, db.numRows, matches, median(times, repeat));
+
+        // Range searches, the first search on an attribute builds its range view and is left out
+        static char *ranges[] = {"", "", "", "", "300-", "0700-0930", "100-250", "-1"};
+        for (int option = 4; option <= 7; option++){
+            double low, high;
+            parseRange(ranges[option], option, &low, &high);
+            searchRangeDB(&db, option, low, high, &result);
+            for (int r = 0; r < repeat; r++){
+                double start = now();
+                matches = searchRangeDB(&db, option, low, high, &result);
+                times[r] = now() - start;
+            }
+            snprintf(argument, sizeof(argument), "%s=%s", sortNames[option], ranges[option]);
+            report("search_range", argument, db.numRows, matches, median(times, repeat));
+        }
+        releaseSearch(&db, &result);
+    }
+
+    for (int r = 0; r < repeat; r++){
+        FILE *out = tmpfile();
+        if (!out){
+            perror("Error Opening Temporary File");
+            exit(EXIT_FAILURE);
+        }
+        double start = now();
+        writeFile(&db, out);
+        fflush(out);
+        times[r] = now() - start;
+        fclose(out);
+    }
+    report("save", "", db.numRows, db.numRows, median(times, repeat));
+
+    char snapshot[] = "/tmp/benchXXXXXX";
+    int fd = mkstemp(snapshot);
+    if (fd < 0){
+        perror("Error Opening Temporary File");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    for (int r = 0; r < repeat; r++){
+        double start = now();
+        if (!writeSnapshot(&db, snapshot, -1)){
+            fprintf(stderr, "Error: cannot write %s\n", snapshot);
+            exit(EXIT_FAILURE);
+        }
+        times[r] = now() - start;
+    }
+    report("save_snapshot", "", db.numRows, db.numRows, median(times, repeat));
+
+    flightDB copy;
+    for (int r = 0; r < repeat; r++){
+        initDB(&copy);
+        double start = now();
+        if (!loadSnapshot(&copy, snapshot, -1)){
+            fprintf(stderr, "Error: cannot load %s\n", snapshot);
+            exit(EXIT_FAILURE);
+        }
+        times[r] = now() - start;
+        freeDB(&copy);
+    }
+    report("load_snapshot", "", db.numRows, db.numRows, median(times, repeat));
+    unlink(snapshot);
+
+    free(fileOrder);
+    free(times);
+    freeDB(&db);
+    return 0;
+}
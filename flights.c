@@ -0,0 +1,3758 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <math.h>
+#include <errno.h>
+#include <curses.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "flights.h"
+
+// Return true if time is correct, split time in String to two hour and minutes in short
+bool validateTime(char time[], short *hour, short *minutes){
+    char temp[3];
+    strncpy(temp, time, 2), temp[2]='\0';
+    *hour = atoi(temp);
+    strncpy(temp, time+2, 2), temp[2]='\0';
+    *minutes = atoi(temp);
+
+    if (*minutes>= 0 && *minutes <= 59 && *hour>=0 && *hour<=23){
+        return true;
+    }else{
+        return false;
+    }
+}
+
+// combine hours and minutes to form a string
+void timecvtString(char *timeStr, short hour, short minutes){
+    sprintf(timeStr, "%02hd%02hd", hour, minutes);
+}
+
+void initPool(slabPool *pool, size_t nodeSize, int nodesPerSlab){
+    memset(pool, 0, sizeof(slabPool));
+    // The free list is threaded through the first word of each free node
+    pool->nodeSize = nodeSize < sizeof(void *) ? sizeof(void *) : nodeSize;
+    pool->nodesPerSlab = nodesPerSlab;
+}
+
+// Hand out a zeroed node, a new slab is only allocated when the free list is empty
+void *allocNode(slabPool *pool){
+    if (pool->freeList == NULL){
+        char *slab = (char *)malloc(pool->nodeSize * pool->nodesPerSlab);
+        void **slabs = (void **)realloc(pool->slabs, (pool->numSlabs + 1) * sizeof(void *));
+        if (slab == NULL || slabs == NULL){
+            endwin();
+            fprintf(stderr, "Error: out of memory for %d pool nodes\n", pool->nodesPerSlab);
+            exit(EXIT_FAILURE);
+        }
+        pool->slabs = slabs;
+        pool->slabs[pool->numSlabs++] = slab;
+        // Chain the nodes of the new slab into the free list, first node ends up on top
+        for (int i = pool->nodesPerSlab - 1; i >= 0; i--){
+            *(void **)(slab + i * pool->nodeSize) = pool->freeList;
+            pool->freeList = slab + i * pool->nodeSize;
+        }
+    }
+    void *node = pool->freeList;
+    pool->freeList = *(void **)node;
+    memset(node, 0, pool->nodeSize);
+
+    pool->liveBytes += pool->nodeSize;
+    if (pool->liveBytes > pool->peakBytes)
+        pool->peakBytes = pool->liveBytes;
+    return node;
+}
+
+void freeNode(slabPool *pool, void *node){
+    *(void **)node = pool->freeList;
+    pool->freeList = node;
+    pool->liveBytes -= pool->nodeSize;
+}
+
+// Give every slab back to the system, all nodes of the pool become invalid
+void freePool(slabPool *pool){
+    for (int i = 0; i < pool->numSlabs; i++){
+        free(pool->slabs[i]);
+    }
+    free(pool->slabs);
+    initPool(pool, pool->nodeSize, pool->nodesPerSlab);
+}
+
+// Pack an airport code of up to 4 letters into an integer, comparing packed codes keeps alphabetical order
+unsigned int packCode(const char *code){
+    unsigned int packed = 0;
+    for (int i = 0; i < 4; i++){
+        packed <<= 8;
+        if (*code != '\0')
+            packed |= (unsigned char)*code++;
+    }
+    return packed;
+}
+
+// Text of a packed airport code
+void unpackCode(unsigned int code, char text[5]){
+    int n = 0;
+    for (int shift = 24; shift >= 0; shift -= 8){
+        if ((code >> shift & 0xff) != 0)
+            text[n++] = code >> shift & 0xff;
+    }
+    text[n] = '\0';
+}
+
+unsigned int hashKey(unsigned long long key){
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (unsigned int)key;
+}
+
+// Return the id of key, a new id is handed out when create is true and the key is unknown
+int lookupId(idMap *map, unsigned long long key, bool create){
+    if (create && (map->numIds + 1) * 2 > map->numBuckets){
+        unsigned long long *oldKeys = map->keys;
+        int *oldIds = map->ids;
+        int oldBuckets = map->numBuckets;
+
+        map->numBuckets = oldBuckets > 0 ? oldBuckets * 2 : 256;
+        map->keys = (unsigned long long *)malloc(map->numBuckets * sizeof(unsigned long long));
+        map->ids = (int *)malloc(map->numBuckets * sizeof(int));
+        if (map->keys == NULL || map->ids == NULL){
+            endwin();
+            fprintf(stderr, "Error: out of memory for the route index\n");
+            exit(EXIT_FAILURE);
+        }
+        memset(map->ids, EMPTY_BUCKET, map->numBuckets * sizeof(int));
+        for (int i = 0; i < oldBuckets; i++){
+            if (oldIds[i] == EMPTY_BUCKET)
+                continue;
+            int bucket = hashKey(oldKeys[i]) & (map->numBuckets - 1);
+            while (map->ids[bucket] != EMPTY_BUCKET)
+                bucket = (bucket + 1) & (map->numBuckets - 1);
+            map->keys[bucket] = oldKeys[i];
+            map->ids[bucket] = oldIds[i];
+        }
+        free(oldKeys);
+        free(oldIds);
+    }
+    if (map->numBuckets == 0)
+        return EMPTY_BUCKET;
+
+    int mask = map->numBuckets - 1;
+    int bucket = hashKey(key) & mask;
+    while (map->ids[bucket] != EMPTY_BUCKET){
+        if (map->keys[bucket] == key)
+            return map->ids[bucket];
+        bucket = (bucket + 1) & mask;
+    }
+    if (!create)
+        return EMPTY_BUCKET;
+    map->keys[bucket] = key;
+    map->ids[bucket] = map->numIds;
+    return map->numIds++;
+}
+
+// Append a row to a posting list and return its slot
+int addPosting(postingList *list, int row){
+    if (list->numRows == list->maxRows){
+        list->maxRows = list->maxRows > 0 ? list->maxRows * 2 : 16;
+        list->rows = (int *)realloc(list->rows, list->maxRows * sizeof(int));
+        if (list->rows == NULL){
+            endwin();
+            fprintf(stderr, "Error: out of memory for the route index\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    list->rows[list->numRows] = row;
+    return list->numRows++;
+}
+
+// Remove the row in slot by moving the last row into it, slots records where every row sits
+void removePosting(postingList *list, int slot, int *slots){
+    int last = list->rows[--list->numRows];
+    list->rows[slot] = last;
+    slots[last] = slot;
+}
+
+// Grow an array of posting lists so that id is valid, new lists are empty
+postingList *reservePostings(postingList *lists, int *maxLists, int id){
+    if (id < *maxLists)
+        return lists;
+    int maxNew = *maxLists > 0 ? *maxLists : 64;
+    while (maxNew <= id)
+        maxNew *= 2;
+    lists = (postingList *)realloc(lists, maxNew * sizeof(postingList));
+    if (lists == NULL){
+        endwin();
+        fprintf(stderr, "Error: out of memory for the route index\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(lists + *maxLists, 0, (maxNew - *maxLists) * sizeof(postingList));
+    *maxLists = maxNew;
+    return lists;
+}
+
+void freeRouteIndex(routeIndex *index){
+    for (int i = 0; i < index->codeIds.numIds; i++){
+        free(index->byOrigin[i].rows);
+        free(index->byDestination[i].rows);
+    }
+    for (int i = 0; i < index->routeIds.numIds; i++){
+        free(index->byRoute[i].rows);
+    }
+    free(index->codeIds.keys);
+    free(index->codeIds.ids);
+    free(index->routeIds.keys);
+    free(index->routeIds.ids);
+    free(index->codes);
+    free(index->byOrigin);
+    free(index->byDestination);
+    free(index->byRoute);
+    free(index->originSlot);
+    free(index->destinationSlot);
+    free(index->routeSlot);
+    free(index->routeOf);
+    memset(index, 0, sizeof(routeIndex));
+}
+
+// Return the id of an airport code, registering it when it is new
+int codeId(routeIndex *index, unsigned int code){
+    int id = lookupId(&index->codeIds, code, true);
+    if (id >= index->maxCodes){
+        int maxCodes = index->maxCodes;
+        index->byOrigin = reservePostings(index->byOrigin, &maxCodes, id);
+        maxCodes = index->maxCodes;
+        index->byDestination = reservePostings(index->byDestination, &maxCodes, id);
+        index->codes = realloc(index->codes, maxCodes * sizeof(index->codes[0]));
+        index->maxCodes = maxCodes;
+    }
+    if (id == index->codeIds.numIds - 1)
+        unpackCode(code, index->codes[id]);
+    return id;
+}
+
+void initDB(flightDB *db){
+    memset(db, 0, sizeof(flightDB));
+    initPool(&db->order.pool, sizeof(orderNode), 64);
+    for (int i = 0; i < SORT_VIEWS + RANGE_VIEWS; i++)
+        initPool(&db->views[i].tree.pool, sizeof(orderNode), 64);
+    pthread_mutex_init(&db->columnLock, NULL);
+}
+
+void freeDB(flightDB *db){
+    free(db->flightNumber);
+    free(db->origin);
+    free(db->destination);
+    free(db->capacity);
+    free(db->departureHour);
+    free(db->departureMinutes);
+    free(db->price);
+    free(db->stops);
+    freePool(&db->order.pool);
+    for (int i = 0; i < SORT_VIEWS + RANGE_VIEWS; i++)
+        freePool(&db->views[i].tree.pool);
+    free(db->freeRows);
+    free(db->flightIdx.heads);
+    free(db->flightIdx.hashes);
+    free(db->flightIdx.nextRow);
+    free(db->flightIdx.prevRow);
+    freeRouteIndex(&db->routeIdx);
+    for (int i = 0; i < db->gramIdx.gramIds.numIds; i++)
+        free(db->gramIdx.byGram[i].rows);
+    free(db->gramIdx.byGram);
+    free(db->gramIdx.gramIds.keys);
+    free(db->gramIdx.gramIds.ids);
+    free(db->leafOf);
+    free(db->sequence);
+    free(db->heldRows);
+    pthread_mutex_destroy(&db->columnLock);
+    initDB(db);
+}
+
+// Size of one row across all columns, used for the memory counters
+#define ROW_BYTES (sizeof(((flightDB *)0)->flightNumber[0]) + 2 * sizeof(((flightDB *)0)->origin[0]) + 5 * sizeof(short) + sizeof(float) + sizeof(orderNode *) + sizeof(int))
+
+void printMemoryStats(flightDB *db){
+    printf("Rows\t\tlive %zu bytes\tpeak %zu bytes\tallocated %zu bytes\t%d rows free for reuse\n",
+    db->liveBytes, db->peakBytes, (size_t)db->maxSlots * ROW_BYTES, db->numFree);
+    printf("Display order\tlive %zu bytes\tpeak %zu bytes\n", db->order.pool.liveBytes, db->order.pool.peakBytes);
+    size_t viewBytes = 0, peakViewBytes = 0;
+    for (int i = 0; i < SORT_VIEWS + RANGE_VIEWS; i++){
+        viewBytes += db->views[i].tree.pool.liveBytes;
+        peakViewBytes += db->views[i].tree.pool.peakBytes;
+    }
+    printf("Sorted views\tlive %zu bytes\tpeak %zu bytes\n", viewBytes, peakViewBytes);
+    printf("Search results\tlive %zu bytes\tpeak %zu bytes\n", db->searchBytes, db->peakSearchBytes);
+}
+
+// Grow every column to hold at least minSlots rows, doubling to keep appends amortised O(1)
+void reserveDB(flightDB *db, int minSlots){
+    if (minSlots <= db->maxSlots){
+        return;
+    }
+    int maxSlots = db->maxSlots > 0 ? db->maxSlots : 64;
+    while (maxSlots < minSlots){
+        maxSlots *= 2;
+    }
+    // a background save may be reading the columns
+    pthread_mutex_lock(&db->columnLock);
+    db->flightNumber = realloc(db->flightNumber, maxSlots * sizeof(db->flightNumber[0]));
+    db->origin = realloc(db->origin, maxSlots * sizeof(db->origin[0]));
+    db->destination = realloc(db->destination, maxSlots * sizeof(db->destination[0]));
+    db->capacity = realloc(db->capacity, maxSlots * sizeof(short));
+    db->departureHour = realloc(db->departureHour, maxSlots * sizeof(short));
+    db->departureMinutes = realloc(db->departureMinutes, maxSlots * sizeof(short));
+    db->price = realloc(db->price, maxSlots * sizeof(float));
+    db->stops = realloc(db->stops, maxSlots * sizeof(short));
+    db->freeRows = realloc(db->freeRows, maxSlots * sizeof(int));
+    db->leafOf = realloc(db->leafOf, maxSlots * sizeof(orderNode *));
+    db->sequence = realloc(db->sequence, maxSlots * sizeof(int));
+    pthread_mutex_unlock(&db->columnLock);
+    if (db->flightNumber == NULL || db->origin == NULL || db->destination == NULL || db->capacity == NULL ||
+        db->departureHour == NULL || db->departureMinutes == NULL || db->price == NULL || db->stops == NULL ||
+        db->freeRows == NULL || db->leafOf == NULL || db->sequence == NULL){
+        endwin();
+        fprintf(stderr, "Error: out of memory for %d rows\n", maxSlots);
+        exit(EXIT_FAILURE);
+    }
+    db->maxSlots = maxSlots;
+}
+
+// Copy a row out of the columns
+void getRecord(flightDB *db, int row, dataSet *record){
+    memcpy(record->flightNumber, db->flightNumber[row], sizeof(record->flightNumber));
+    unpackCode(db->origin[row], record->origin);
+    unpackCode(db->destination[row], record->destination);
+    record->capacity = db->capacity[row];
+    record->departureHour = db->departureHour[row];
+    record->departureMinutes = db->departureMinutes[row];
+    record->price = db->price[row];
+    record->stops = db->stops[row];
+}
+
+// Copy a record into the columns of a row
+void setRecord(flightDB *db, int row, dataSet *record){
+    memcpy(db->flightNumber[row], record->flightNumber, sizeof(record->flightNumber));
+    db->origin[row] = packCode(record->origin);
+    db->destination[row] = packCode(record->destination);
+    db->capacity[row] = record->capacity;
+    db->departureHour[row] = record->departureHour;
+    db->departureMinutes[row] = record->departureMinutes;
+    db->price[row] = record->price;
+    db->stops[row] = record->stops;
+}
+
+// FNV-1a hash of a flight number
+unsigned int hashFlight(const char *flightNumber){
+    unsigned int hash = 2166136261u;
+    while (*flightNumber != '\0'){
+        hash ^= (unsigned char)*flightNumber++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void placeFlight(flightIndex *index, int head, unsigned int hash){
+    int mask = index->numBuckets - 1;
+    int bucket = hash & mask;
+    while (index->heads[bucket] != EMPTY_BUCKET){
+        bucket = (bucket + 1) & mask;
+    }
+    index->heads[bucket] = head;
+    index->hashes[bucket] = hash;
+}
+
+// Make room for numKeys flight numbers while keeping the table at most half full, existing keys are rehashed
+void reserveFlightIndex(flightIndex *index, int numKeys){
+    if (numKeys * 2 <= index->numBuckets)
+        return;
+    int *oldHeads = index->heads;
+    unsigned int *oldHashes = index->hashes;
+    int oldBuckets = index->numBuckets;
+
+    index->numBuckets = oldBuckets > 0 ? oldBuckets : 1024;
+    while (numKeys * 2 > index->numBuckets)
+        index->numBuckets *= 2;
+    index->heads = (int *)malloc(index->numBuckets * sizeof(int));
+    index->hashes = (unsigned int *)malloc(index->numBuckets * sizeof(unsigned int));
+    if (index->heads == NULL || index->hashes == NULL){
+        endwin();
+        fprintf(stderr, "Error: out of memory for the flight number index\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(index->heads, EMPTY_BUCKET, index->numBuckets * sizeof(int));
+    for (int i = 0; i < oldBuckets; i++){
+        if (oldHeads[i] != EMPTY_BUCKET)
+            placeFlight(index, oldHeads[i], oldHashes[i]);
+    }
+    free(oldHeads);
+    free(oldHashes);
+}
+
+// Return the bucket holding the flight number, or the empty bucket that ends its probe run
+int findFlight(flightDB *db, const char *flightNumber, unsigned int hash){
+    flightIndex *index = &db->flightIdx;
+    int mask = index->numBuckets - 1;
+    int bucket = hash & mask;
+    while (index->heads[bucket] != EMPTY_BUCKET &&
+           (index->hashes[bucket] != hash || strcmp(db->flightNumber[index->heads[bucket]], flightNumber) != 0)){
+        bucket = (bucket + 1) & mask;
+    }
+    return bucket;
+}
+
+// Add a row to the flight number index, it becomes the head of the chain of its flight number
+void indexFlight(flightDB *db, int row){
+    flightIndex *index = &db->flightIdx;
+    if (row >= index->maxRows){
+        index->maxRows = db->maxSlots;
+        index->nextRow = (int *)realloc(index->nextRow, index->maxRows * sizeof(int));
+        index->prevRow = (int *)realloc(index->prevRow, index->maxRows * sizeof(int));
+        if (index->nextRow == NULL || index->prevRow == NULL){
+            endwin();
+            fprintf(stderr, "Error: out of memory for the flight number index\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    reserveFlightIndex(index, index->numKeys + 1);
+
+    unsigned int hash = hashFlight(db->flightNumber[row]);
+    int bucket = findFlight(db, db->flightNumber[row], hash);
+    index->prevRow[row] = EMPTY_BUCKET;
+    if (index->heads[bucket] == EMPTY_BUCKET){
+        index->nextRow[row] = EMPTY_BUCKET;
+        index->hashes[bucket] = hash;
+        index->numKeys++;
+    }else{
+        index->nextRow[row] = index->heads[bucket];
+        index->prevRow[index->heads[bucket]] = row;
+    }
+    index->heads[bucket] = row;
+}
+
+// Remove a row from the flight number index
+// When its flight number has no rows left the key is removed and later keys of the probe run are shifted back into the gap
+void unindexFlight(flightDB *db, int row){
+    flightIndex *index = &db->flightIdx;
+    int next = index->nextRow[row], prev = index->prevRow[row];
+
+    if (prev != EMPTY_BUCKET){
+        index->nextRow[prev] = next;
+        if (next != EMPTY_BUCKET)
+            index->prevRow[next] = prev;
+        return;
+    }
+    int gap = findFlight(db, db->flightNumber[row], hashFlight(db->flightNumber[row]));
+    if (next != EMPTY_BUCKET){
+        index->heads[gap] = next;
+        index->prevRow[next] = EMPTY_BUCKET;
+        return;
+    }
+
+    int mask = index->numBuckets - 1;
+    for (int bucket = (gap + 1) & mask; index->heads[bucket] != EMPTY_BUCKET; bucket = (bucket + 1) & mask){
+        int home = index->hashes[bucket] & mask;
+        // Move the key when its home bucket is not between the gap and its current bucket
+        if (((bucket - home) & mask) >= ((bucket - gap) & mask)){
+            index->heads[gap] = index->heads[bucket];
+            index->hashes[gap] = index->hashes[bucket];
+            gap = bucket;
+        }
+    }
+    index->heads[gap] = EMPTY_BUCKET;
+    index->numKeys--;
+}
+
+// Add a row to the origin, destination and route posting lists
+void indexRoute(flightDB *db, int row){
+    routeIndex *index = &db->routeIdx;
+    if (row >= index->maxRows){
+        index->maxRows = db->maxSlots;
+        index->originSlot = (int *)realloc(index->originSlot, index->maxRows * sizeof(int));
+        index->destinationSlot = (int *)realloc(index->destinationSlot, index->maxRows * sizeof(int));
+        index->routeSlot = (int *)realloc(index->routeSlot, index->maxRows * sizeof(int));
+        index->routeOf = (int *)realloc(index->routeOf, index->maxRows * sizeof(int));
+        if (index->originSlot == NULL || index->destinationSlot == NULL || index->routeSlot == NULL || index->routeOf == NULL){
+            endwin();
+            fprintf(stderr, "Error: out of memory for the route index\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    int origin = codeId(index, db->origin[row]);
+    int destination = codeId(index, db->destination[row]);
+    int route = lookupId(&index->routeIds, (unsigned long long)origin << 32 | destination, true);
+    index->byRoute = reservePostings(index->byRoute, &index->maxRoutes, route);
+
+    index->originSlot[row] = addPosting(&index->byOrigin[origin], row);
+    index->destinationSlot[row] = addPosting(&index->byDestination[destination], row);
+    index->routeSlot[row] = addPosting(&index->byRoute[route], row);
+    index->routeOf[row] = route;
+}
+
+void unindexRoute(flightDB *db, int row){
+    routeIndex *index = &db->routeIdx;
+    int origin = lookupId(&index->codeIds, db->origin[row], false);
+    int destination = lookupId(&index->codeIds, db->destination[row], false);
+
+    removePosting(&index->byOrigin[origin], index->originSlot[row], index->originSlot);
+    removePosting(&index->byDestination[destination], index->destinationSlot[row], index->destinationSlot);
+    removePosting(&index->byRoute[index->routeOf[row]], index->routeSlot[row], index->routeSlot);
+}
+
+// Pack the three bytes of a trigram into one key
+unsigned long long packGram(const char *gram){
+    return (unsigned long long)(unsigned char)gram[0] << 16 | (unsigned char)gram[1] << 8 | (unsigned char)gram[2];
+}
+
+// Return the slot of the first row in a sorted posting list that is not below row
+int lowerBound(postingList *list, int row){
+    int low = 0, high = list->numRows;
+    while (low < high){
+        int mid = (low + high) / 2;
+        if (list->rows[mid] < row)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+// Add every distinct trigram of the flight number of row, rows mostly arrive in increasing order so this is an append
+void indexGrams(flightDB *db, int row){
+    gramIndex *index = &db->gramIdx;
+    const char *flight = db->flightNumber[row];
+    int length = strlen(flight);
+
+    for (int i = 0; i + 3 <= length; i++){
+        int id = lookupId(&index->gramIds, packGram(flight + i), true);
+        index->byGram = reservePostings(index->byGram, &index->maxGrams, id);
+        postingList *list = &index->byGram[id];
+        if (list->numRows > 0 && list->rows[list->numRows - 1] == row)
+            continue;
+        if (list->numRows == 0 || list->rows[list->numRows - 1] < row){
+            addPosting(list, row);
+            continue;
+        }
+        int slot = lowerBound(list, row);
+        if (list->rows[slot] == row)
+            continue;
+        addPosting(list, row);
+        memmove(&list->rows[slot + 1], &list->rows[slot], (list->numRows - slot - 1) * sizeof(int));
+        list->rows[slot] = row;
+    }
+}
+
+void unindexGrams(flightDB *db, int row){
+    gramIndex *index = &db->gramIdx;
+    const char *flight = db->flightNumber[row];
+    int length = strlen(flight);
+
+    for (int i = 0; i + 3 <= length; i++){
+        int id = lookupId(&index->gramIds, packGram(flight + i), false);
+        postingList *list = &index->byGram[id];
+        int slot = lowerBound(list, row);
+        // A trigram repeated in the same flight number was already removed
+        if (slot == list->numRows || list->rows[slot] != row)
+            continue;
+        memmove(&list->rows[slot], &list->rows[slot + 1], (list->numRows - slot - 1) * sizeof(int));
+        list->numRows--;
+    }
+}
+
+// Keep every index in step with a row that becomes live or goes away
+void indexRow(flightDB *db, int row){
+    if (db->indexPending)
+        return;
+    indexFlight(db, row);
+    indexRoute(db, row);
+    indexGrams(db, row);
+}
+
+void unindexRow(flightDB *db, int row){
+    if (db->indexPending)
+        return;
+    unindexFlight(db, row);
+    unindexRoute(db, row);
+    unindexGrams(db, row);
+}
+
+// Leaf of an order tree holding a position, slot receives the position inside the leaf
+orderNode *seekTree(orderTree *tree, int position, int *slot){
+    orderNode *node = tree->root;
+    if (node == NULL || position < 0 || position >= node->count){
+        return NULL;
+    }
+    while (!node->leaf){
+        int c = 0;
+        while (position >= node->children[c]->count){
+            position -= node->children[c]->count;
+            c++;
+        }
+        node = node->children[c];
+    }
+    *slot = position;
+    return node;
+}
+
+orderNode *seekOrder(flightDB *db, int position, int *slot){
+    return seekTree(&db->order, position, slot);
+}
+
+// Row listed at a display position
+int rowAt(flightDB *db, int position){
+    int slot = 0;
+    orderNode *leaf = seekOrder(db, position, &slot);
+    return leaf->rows[slot];
+}
+
+// Display position of a row, climbs from the leaf of the row adding up the siblings on the left
+int positionOf(flightDB *db, int row){
+    orderNode *node = db->leafOf[row];
+    int position = 0;
+    while (node->rows[position] != row){
+        position++;
+    }
+    for (orderNode *parent = node->parent; parent != NULL; node = parent, parent = parent->parent){
+        for (int c = 0; parent->children[c] != node; c++)
+            position += parent->children[c]->count;
+    }
+    return position;
+}
+
+// Copy the rows of an order tree into rows, which must hold all of them
+void treeRows(orderTree *tree, int rows[]){
+    int slot, n = 0;
+    for (orderNode *leaf = seekTree(tree, 0, &slot); leaf != NULL; leaf = leaf->next){
+        memcpy(rows + n, leaf->rows, leaf->numItems * sizeof(int));
+        n += leaf->numItems;
+    }
+}
+
+// Rows at positions from to to-1 of a tree
+void sliceTree(orderTree *tree, int from, int to, int rows[]){
+    int slot, n = 0;
+    for (orderNode *leaf = seekTree(tree, from, &slot); n < to - from; leaf = leaf->next, slot = 0){
+        for (; slot < leaf->numItems && n < to - from; slot++)
+            rows[n++] = leaf->rows[slot];
+    }
+}
+
+// Copy the display order into rows, which must hold numRows rows
+void orderRows(flightDB *db, int rows[]){
+    treeRows(&db->order, rows);
+}
+
+// Split a full node in two, the right half goes to a new node placed after it in the parent
+// Only the display order keeps leafOf up to date
+void splitTree(flightDB *db, orderTree *tree, orderNode *node){
+    orderNode *right = (orderNode *)allocNode(&tree->pool);
+    int half = node->numItems / 2;
+    right->leaf = node->leaf;
+    right->numItems = node->numItems - half;
+    if (node->leaf){
+        memcpy(right->rows, node->rows + half, right->numItems * sizeof(int));
+        right->count = right->numItems;
+        if (tree == &db->order){
+            for (int i = 0; i < right->numItems; i++)
+                db->leafOf[right->rows[i]] = right;
+        }
+        right->next = node->next;
+        right->prev = node;
+        if (node->next != NULL)
+            node->next->prev = right;
+        node->next = right;
+    }else{
+        memcpy(right->children, node->children + half, right->numItems * sizeof(orderNode *));
+        for (int i = 0; i < right->numItems; i++){
+            right->children[i]->parent = right;
+            right->count += right->children[i]->count;
+        }
+    }
+    node->numItems = half;
+    node->count -= right->count;
+
+    orderNode *parent = node->parent;
+    if (parent == NULL){
+        // The root was split, the tree grows by one level
+        parent = (orderNode *)allocNode(&tree->pool);
+        parent->numItems = 1;
+        parent->children[0] = node;
+        parent->count = node->count + right->count;
+        node->parent = parent;
+        tree->root = parent;
+    }
+    int c = 0;
+    while (parent->children[c] != node){
+        c++;
+    }
+    memmove(&parent->children[c + 2], &parent->children[c + 1], (parent->numItems - c - 1) * sizeof(orderNode *));
+    parent->children[c + 1] = right;
+    parent->numItems++;
+    right->parent = parent;
+    if (parent->numItems == ORDER_FANOUT)
+        splitTree(db, tree, parent);
+}
+
+// Place a row at a position of an order tree
+void insertTree(flightDB *db, orderTree *tree, int position, int row){
+    if (tree->root == NULL){
+        tree->root = (orderNode *)allocNode(&tree->pool);
+        tree->root->leaf = true;
+    }
+    // Walk down counting the new row in every node on the way, a position at the end of a child stays in that child
+    orderNode *node = tree->root;
+    while (!node->leaf){
+        node->count++;
+        int c = 0;
+        while (c < node->numItems - 1 && position > node->children[c]->count){
+            position -= node->children[c]->count;
+            c++;
+        }
+        node = node->children[c];
+    }
+    memmove(&node->rows[position + 1], &node->rows[position], (node->numItems - position) * sizeof(int));
+    node->rows[position] = row;
+    node->numItems++;
+    node->count++;
+    if (tree == &db->order)
+        db->leafOf[row] = node;
+    if (node->numItems == ORDER_LEAF_ROWS)
+        splitTree(db, tree, node);
+}
+
+void insertOrder(flightDB *db, int position, int row){
+    db->version++;
+    insertTree(db, &db->order, position, row);
+}
+
+// Take the row at a position out of an order tree and return it
+// Nodes are not merged when they get small, only released once empty, sorting rebuilds a compact tree
+int removeTree(orderTree *tree, int position){
+    orderNode *node = tree->root;
+    while (!node->leaf){
+        node->count--;
+        int c = 0;
+        while (position >= node->children[c]->count){
+            position -= node->children[c]->count;
+            c++;
+        }
+        node = node->children[c];
+    }
+    int row = node->rows[position];
+    memmove(&node->rows[position], &node->rows[position + 1], (node->numItems - position - 1) * sizeof(int));
+    node->numItems--;
+    node->count--;
+
+    while (node->numItems == 0 && node->parent != NULL){
+        orderNode *parent = node->parent;
+        int c = 0;
+        while (parent->children[c] != node){
+            c++;
+        }
+        memmove(&parent->children[c], &parent->children[c + 1], (parent->numItems - c - 1) * sizeof(orderNode *));
+        parent->numItems--;
+        if (node->leaf){
+            if (node->prev != NULL)
+                node->prev->next = node->next;
+            if (node->next != NULL)
+                node->next->prev = node->prev;
+        }
+        freeNode(&tree->pool, node);
+        node = parent;
+    }
+    // Drop root levels left with a single child
+    while (!tree->root->leaf && tree->root->numItems == 1){
+        orderNode *root = tree->root;
+        tree->root = root->children[0];
+        tree->root->parent = NULL;
+        freeNode(&tree->pool, root);
+    }
+    return row;
+}
+
+int removeOrder(flightDB *db, int position){
+    db->version++;
+    return removeTree(&db->order, position);
+}
+
+// Replace an order tree with n rows, nodes are filled to three quarters to leave room for inserts
+void buildTree(flightDB *db, orderTree *tree, int rows[], int n){
+    freePool(&tree->pool);
+    tree->root = NULL;
+    if (n == 0){
+        return;
+    }
+    int numNodes = (n + ORDER_LEAF_ROWS * 3 / 4 - 1) / (ORDER_LEAF_ROWS * 3 / 4);
+    orderNode **level = (orderNode **)malloc(numNodes * sizeof(orderNode *));
+    orderNode *prev = NULL;
+    for (int i = 0; i < numNodes; i++){
+        orderNode *leaf = (orderNode *)allocNode(&tree->pool);
+        int first = (int)((long long)n * i / numNodes), last = (int)((long long)n * (i + 1) / numNodes);
+        leaf->leaf = true;
+        leaf->numItems = leaf->count = last - first;
+        memcpy(leaf->rows, rows + first, leaf->numItems * sizeof(int));
+        if (tree == &db->order){
+            for (int j = first; j < last; j++)
+                db->leafOf[rows[j]] = leaf;
+        }
+        leaf->prev = prev;
+        if (prev != NULL)
+            prev->next = leaf;
+        prev = leaf;
+        level[i] = leaf;
+    }
+    // Group every level under parents until a single root is left
+    while (numNodes > 1){
+        int numParents = (numNodes + ORDER_FANOUT * 3 / 4 - 1) / (ORDER_FANOUT * 3 / 4);
+        for (int i = 0; i < numParents; i++){
+            orderNode *parent = (orderNode *)allocNode(&tree->pool);
+            int first = (int)((long long)numNodes * i / numParents), last = (int)((long long)numNodes * (i + 1) / numParents);
+            for (int j = first; j < last; j++){
+                parent->children[parent->numItems++] = level[j];
+                parent->count += level[j]->count;
+                level[j]->parent = parent;
+            }
+            level[i] = parent;
+        }
+        numNodes = numParents;
+    }
+    tree->root = level[0];
+    free(level);
+}
+
+void buildOrder(flightDB *db, int rows[], int n){
+    db->version++;
+    buildTree(db, &db->order, rows, n);
+}
+
+// Store a record in a free row, reusing deleted rows before growing the columns
+// The row is neither indexed nor placed in the display order yet
+int storeRow(flightDB *db, dataSet *record){
+    int row;
+    if (db->numFree > 0){
+        row = db->freeRows[--db->numFree];
+    }else{
+        reserveDB(db, db->numSlots + 1);
+        row = db->numSlots++;
+    }
+    setRecord(db, row, record);
+    db->sequence[row] = db->nextSequence++;
+
+    db->liveBytes += ROW_BYTES;
+    if (db->liveBytes > db->peakBytes)
+        db->peakBytes = db->liveBytes;
+    return row;
+}
+
+int newRow(flightDB *db, dataSet *record){
+    int row = storeRow(db, record);
+    indexRow(db, row);
+    return row;
+}
+
+typedef struct indexPass{
+    flightDB *db;
+    int *rows;
+    int numRows;
+}indexPass;
+
+// The three indexes share nothing but the columns they read, so each can be built on its own thread
+void indexPassTask(void *context, int index, int worker){
+    indexPass *pass = (indexPass *)context;
+    void (*indexOne)(flightDB *db, int row) = index == 0 ? indexFlight : (index == 1 ? indexRoute : indexGrams);
+    for (int i = 0; i < pass->numRows; i++)
+        indexOne(pass->db, pass->rows[i]);
+    (void)worker;
+}
+
+// Index rows that are already stored, one index at a time
+// Used after bulk loading, each pass keeps a single index hot in the cache and large loads run the passes in parallel
+void indexRows(flightDB *db, int rows[], int numRows){
+    indexPass pass = {db, rows, numRows};
+    if (numRows >= PARALLEL_INDEX_ROWS){
+        runParallel(3, indexPassTask, &pass);
+        return;
+    }
+    for (int index = 0; index < 3; index++)
+        indexPassTask(&pass, index, 0);
+}
+
+// Index the rows of a snapshot before their first search, live rows are visited in row order like a text load
+void ensureIndexes(flightDB *db){
+    if (!db->indexPending)
+        return;
+    db->indexPending = false;
+    bool *deleted = (bool *)calloc(db->numSlots > 0 ? db->numSlots : 1, sizeof(bool));
+    int *rows = (int *)malloc((db->numSlots > 0 ? db->numSlots : 1) * sizeof(int));
+    int numRows = 0;
+    for (int i = 0; i < db->numFree; i++)
+        deleted[db->freeRows[i]] = true;
+    for (int i = 0; i < db->numHeld; i++)
+        deleted[db->heldRows[i]] = true;
+    for (int row = 0; row < db->numSlots; row++){
+        if (!deleted[row])
+            rows[numRows++] = row;
+    }
+    indexRows(db, rows, numRows);
+    free(rows);
+    free(deleted);
+}
+
+// Write a row as a line of the dataset
+void writeRecord(flightDB *db, int row, FILE *fp){
+    char timeStr[5], origin[5], destination[5];
+    timecvtString(timeStr, db->departureHour[row], db->departureMinutes[row]);
+    unpackCode(db->origin[row], origin);
+    unpackCode(db->destination[row], destination);
+    fprintf(fp, "%s,%s,%s,%hd,%s,%.2f,%hd,\n", db->flightNumber[row], origin, destination,
+    db->capacity[row], timeStr, db->price[row], db->stops[row]);
+}
+
+// Make the journal durable, records are already flushed to the system one by one
+void syncJournal(journal *log){
+    if (log->fp != NULL && log->pending > 0){
+        fflush(log->fp);
+        fdatasync(fileno(log->fp));
+    }
+    log->pending = 0;
+    log->syncedAt = time(NULL);
+}
+
+// Finish a journal record, fsyncs are batched so a burst of edits costs one
+void endRecord(journal *log){
+    fflush(log->fp);
+    log->bytes = ftell(log->fp);
+    if (++log->pending >= JOURNAL_SYNC_RECORDS || time(NULL) - log->syncedAt >= JOURNAL_SYNC_SECONDS)
+        syncJournal(log);
+}
+
+// Journal records: "A line", "I position line", "D position", "U position line" and "S attribute[-] ..."
+// Positions are 0-based, a '-' after a sort attribute makes it descending
+void logEdit(flightDB *db, char op, int position, int row){
+    journal *log = db->log;
+    if (log == NULL || log->fp == NULL)
+        return;
+    fputc(op, log->fp);
+    if (op != 'A')
+        fprintf(log->fp, " %d", position);
+    if (op == 'D'){
+        fputc('\n', log->fp);
+    }else{
+        fputc(' ', log->fp);
+        writeRecord(db, row, log->fp);
+    }
+    endRecord(log);
+}
+
+void logSort(flightDB *db, sortKey keys[], int nKeys){
+    journal *log = db->log;
+    if (log == NULL || log->fp == NULL)
+        return;
+    fputc('S', log->fp);
+    for (int i = 0; i < nKeys; i++)
+        fprintf(log->fp, " %d%s", keys[i].attribute, keys[i].descending ? "-" : "");
+    fputc('\n', log->fp);
+    log->numSorts++;
+    endRecord(log);
+}
+
+// The display order became the sequence order, replay has to number the rows at the same point
+void logRenumber(flightDB *db){
+    journal *log = db->log;
+    if (log == NULL || log->fp == NULL)
+        return;
+    fputs("R\n", log->fp);
+    endRecord(log);
+}
+
+// Compare two rows on a single attribute, option 1-7 follows the attribute row order
+int compareAttribute(flightDB *db, int a, int b, int option){
+    int result = 0;
+    switch (option)
+    {
+    case 1:
+        result = strcmp(db->flightNumber[a], db->flightNumber[b]);
+        break;
+    case 2:
+        result = (db->origin[a] > db->origin[b]) - (db->origin[a] < db->origin[b]);
+        break;
+    case 3:
+        result = (db->destination[a] > db->destination[b]) - (db->destination[a] < db->destination[b]);
+        break;
+    case 4:
+        result = db->capacity[a] - db->capacity[b];
+        break;
+    case 5:
+        result = (db->departureHour[a] * 60 + db->departureMinutes[a]) - (db->departureHour[b] * 60 + db->departureMinutes[b]);
+        break;
+    case 6:
+        // Compare directly instead of subtracting, a float difference below 1 truncates to 0 as an int
+        result = (db->price[a] > db->price[b]) - (db->price[a] < db->price[b]);
+        break;
+    case 7:
+        result = db->stops[a] - db->stops[b];
+        break;
+    default:
+        break;
+    }
+    return result;
+}
+
+// Compare two rows key by key, the first key that differs decides the order
+int compareKeys(flightDB *db, int a, int b, sortKey keys[], int nKeys){
+    for (int i = 0; i < nKeys; i++){
+        int result = compareAttribute(db, a, b, keys[i].attribute);
+        if (result != 0){
+            return keys[i].descending ? -result : result;
+        }
+    }
+    return 0;
+}
+
+// Number the rows in display order, equal keys of later sorts keep this order and rows stored later come after them
+// Views sorted with the old numbers are dropped
+void numberRows(flightDB *db){
+    int slot, n = 0;
+    for (orderNode *leaf = seekOrder(db, 0, &slot); leaf != NULL; leaf = leaf->next){
+        for (slot = 0; slot < leaf->numItems; slot++)
+            db->sequence[leaf->rows[slot]] = n++;
+    }
+    db->nextSequence = n;
+    for (int i = 0; i < SORT_VIEWS + RANGE_VIEWS; i++){
+        buildTree(db, &db->views[i].tree, NULL, 0);
+        db->views[i].usedAt = 0;
+    }
+}
+
+// Compare two rows in the order of a view, the sequence number breaks ties
+int compareView(flightDB *db, int a, int b, sortKey *key){
+    int result = compareKeys(db, a, b, key, 1);
+    if (result != 0)
+        return result;
+    return (db->sequence[a] > db->sequence[b]) - (db->sequence[a] < db->sequence[b]);
+}
+
+// Rows of a tree that come before a target, found by comparing with the first row of each child on the way down
+// before tells whether a row comes before the target, the tree has to list every such row first
+int treeRank(flightDB *db, orderTree *tree, bool (*before)(flightDB *db, int row, void *target), void *target){
+    orderNode *node = tree->root;
+    int rank = 0;
+    if (node == NULL)
+        return 0;
+    while (!node->leaf){
+        int lo = 1, hi = node->numItems;
+        // the last child whose first row comes before the target, or the first child
+        while (lo < hi){
+            int c = (lo + hi) / 2;
+            orderNode *first = node->children[c];
+            while (!first->leaf)
+                first = first->children[0];
+            if (before(db, first->rows[0], target))
+                lo = c + 1;
+            else
+                hi = c;
+        }
+        for (int c = 0; c < lo - 1; c++)
+            rank += node->children[c]->count;
+        node = node->children[lo - 1];
+    }
+    int lo = 0, hi = node->numItems;
+    while (lo < hi){
+        int i = (lo + hi) / 2;
+        if (before(db, node->rows[i], target))
+            lo = i + 1;
+        else
+            hi = i;
+    }
+    return rank + lo;
+}
+
+typedef struct viewTarget{
+    sortKey *key;
+    int row;
+}viewTarget;
+
+bool rowBefore(flightDB *db, int row, void *target){
+    viewTarget *t = (viewTarget *)target;
+    return compareView(db, row, t->row, t->key) < 0;
+}
+
+// Rows of a view that come before row
+int viewRank(flightDB *db, sortView *view, int row){
+    viewTarget target = {&view->key, row};
+    return treeRank(db, &view->tree, rowBefore, &target);
+}
+
+// Place a new or changed row in every view, O(log n) each
+void addToViews(flightDB *db, int row){
+    for (int i = 0; i < SORT_VIEWS + RANGE_VIEWS; i++){
+        if (db->views[i].usedAt != 0)
+            insertTree(db, &db->views[i].tree, viewRank(db, &db->views[i], row), row);
+    }
+}
+
+// Take a row out of every view, before its record changes
+void removeFromViews(flightDB *db, int row){
+    for (int i = 0; i < SORT_VIEWS + RANGE_VIEWS; i++){
+        if (db->views[i].usedAt != 0)
+            removeTree(&db->views[i].tree, viewRank(db, &db->views[i], row));
+    }
+}
+
+// Add a record at the end of the display order
+void appendDB(flightDB *db, dataSet *record){
+    int row = newRow(db, record);
+    insertOrder(db, db->numRows++, row);
+    addToViews(db, row);
+    logEdit(db, 'A', 0, row);
+}
+
+// Insert a record so that it ends up at the given display position
+void insertDB(flightDB *db, int position, dataSet *record){
+    if (position < 0)
+        position = 0;
+    if (position > db->numRows)
+        position = db->numRows;
+    int row = newRow(db, record);
+    insertOrder(db, position, row);
+    addToViews(db, row);
+    db->numRows++;
+    logEdit(db, 'I', position, row);
+}
+
+// Keep a deleted row away from newRow while a background save may still read it
+void holdRow(flightDB *db, int row){
+    if (db->numHeld == db->maxHeld){
+        db->maxHeld = db->maxHeld > 0 ? db->maxHeld * 2 : 64;
+        db->heldRows = (int *)realloc(db->heldRows, db->maxHeld * sizeof(int));
+    }
+    db->heldRows[db->numHeld++] = row;
+}
+
+// The save is over, held rows can be reused
+void releaseRows(flightDB *db){
+    for (int i = 0; i < db->numHeld; i++)
+        db->freeRows[db->numFree++] = db->heldRows[i];
+    db->numHeld = 0;
+    db->copyOnWrite = false;
+}
+
+// Remove the row at the given display position, the row goes on the free list
+void deleteDB(flightDB *db, int position){
+    if (position < 0 || position >= db->numRows)
+        return;
+    int row = removeOrder(db, position);
+    removeFromViews(db, row);
+    db->numRows--;
+    if (db->copyOnWrite)
+        holdRow(db, row);
+    else
+        db->freeRows[db->numFree++] = row;
+    unindexRow(db, row);
+    db->liveBytes -= ROW_BYTES;
+    logEdit(db, 'D', position, row);
+}
+
+// Overwrite the row at the given display position
+// While a background save reads the rows the record goes to a new row that takes the place of the old one
+void updateDB(flightDB *db, int position, dataSet *record){
+    if (position < 0 || position >= db->numRows)
+        return;
+    int slot = 0;
+    orderNode *leaf = seekOrder(db, position, &slot);
+    int row = leaf->rows[slot];
+    unindexRow(db, row);
+    removeFromViews(db, row);
+    if (db->copyOnWrite){
+        holdRow(db, row);
+        db->liveBytes -= ROW_BYTES;
+        int sequence = db->sequence[row];
+        row = storeRow(db, record);
+        db->sequence[row] = sequence;
+        leaf->rows[slot] = row;
+        db->leafOf[row] = leaf;
+    }else{
+        setRecord(db, row, record);
+    }
+    indexRow(db, row);
+    addToViews(db, row);
+    db->version++;
+    logEdit(db, 'U', position, row);
+}
+
+void printTable(flightDB *db){
+    printf("Num\tFlight Number\tOrigin\tDestination\tCapacity\tDeparture Time\tPrice\t\tStops\tRow\n");
+
+    int slot, i = 0;
+    for (orderNode *leaf = seekOrder(db, 0, &slot); leaf != NULL; leaf = leaf->next){
+        for (slot = 0; slot < leaf->numItems; slot++, i++){
+            int row = leaf->rows[slot];
+            char origin[5], destination[5];
+            unpackCode(db->origin[row], origin);
+            unpackCode(db->destination[row], destination);
+            printf("%d\t%s\t\t%s\t%s\t\t%hd\t\t%02hd%02hd\t\t%f\t%hd\t%d\n", i + 1, db->flightNumber[row], origin, destination,
+            db->capacity[row], db->departureHour[row], db->departureMinutes[row], db->price[row], db->stops[row], row);
+        }
+    }
+    return;
+}
+
+// Print the rows returned by a search function
+void printSearch(flightDB *db, searchResult *result){
+    printf("Num\tFlight Number\tOrigin\tDestination\tCapacity\tDeparture Time\tPrice\t\tStops\tRow\n");
+    for (int i = 0; i < result->numRows; i++){
+        int row = result->rows[i];
+        char origin[5], destination[5];
+        unpackCode(db->origin[row], origin);
+        unpackCode(db->destination[row], destination);
+        printf("%d\t%s\t\t%s\t%s\t\t%hd\t\t%02hd%02hd\t\t%f\t%hd\t%d\n", i + 1, db->flightNumber[row], origin, destination,
+        db->capacity[row], db->departureHour[row], db->departureMinutes[row], db->price[row], db->stops[row], row);
+    }
+    return;
+}
+
+unsigned char charClass[256];
+
+void initCharClass(){
+    for (int c = 0; c < 256; c++){
+        charClass[c] = 0;
+        if (c >= '0' && c <= '9')
+            charClass[c] |= CLASS_DIGIT;
+        if (c >= 'A' && c <= 'Z')
+            charClass[c] |= CLASS_UPPER;
+        if (c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r')
+            charClass[c] |= CLASS_SPACE;
+        if (c != ',' && c != '\n' && c != '\0')
+            charClass[c] |= CLASS_FIELD;
+    }
+}
+
+// Copy an airport code of [A-Z]+ ending with a comma, code must fit in a char[5]
+const char *parseCode(const char *p, const char *end, char code[5]){
+    int n = 0;
+    while (p < end && (charClass[(unsigned char)*p] & CLASS_UPPER)){
+        if (n == 4)
+            return NULL;
+        code[n++] = *p++;
+    }
+    code[n] = '\0';
+    if (n == 0 || p == end || *p != ',')
+        return NULL;
+    return p + 1;
+}
+
+// Parse one record line between p and end following the grammar of REGEX_EXPRESSION
+// Fields are read straight from the mapped file, return PARSE_OK, PARSE_FORMAT_ERROR or PARSE_TIME_ERROR
+int parseRecord(const char *p, const char *end, dataSet *record){
+    const char *field = p;
+    const char *q;
+    int n;
+
+    // Flight number: 2 or 3 characters, white space, then digits
+    for (n = 2; n <= 3; n++){
+        if (end - p <= n || !(charClass[(unsigned char)p[0]] & CLASS_FIELD) || !(charClass[(unsigned char)p[1]] & CLASS_FIELD))
+            return PARSE_FORMAT_ERROR;
+        if (n == 3 && !(charClass[(unsigned char)p[2]] & CLASS_FIELD))
+            return PARSE_FORMAT_ERROR;
+        if (!(charClass[(unsigned char)p[n]] & CLASS_SPACE))
+            continue;
+        q = p + n + 1;
+        while (q < end && (charClass[(unsigned char)*q] & CLASS_DIGIT))
+            q++;
+        if (q < end && *q == ',')
+            break;
+    }
+    if (n > 3 || q - field > 19)
+        return PARSE_FORMAT_ERROR;
+    memcpy(record->flightNumber, field, q - field);
+    record->flightNumber[q - field] = '\0';
+    p = q + 1;
+
+    if ((p = parseCode(p, end, record->origin)) == NULL)
+        return PARSE_FORMAT_ERROR;
+    if ((p = parseCode(p, end, record->destination)) == NULL)
+        return PARSE_FORMAT_ERROR;
+
+    // Capacity: [0-9]+ that fits in a short
+    int capacity = 0;
+    for (n = 0; p < end && (charClass[(unsigned char)*p] & CLASS_DIGIT); n++, p++){
+        capacity = capacity * 10 + (*p - '0');
+        if (capacity > 32767)
+            return PARSE_FORMAT_ERROR;
+    }
+    if (n == 0 || p == end || *p++ != ',')
+        return PARSE_FORMAT_ERROR;
+    record->capacity = capacity;
+
+    // Departure time: exactly 4 digits, range is checked after the rest of the line is valid
+    if (end - p < 5)
+        return PARSE_FORMAT_ERROR;
+    for (n = 0; n < 4; n++){
+        if (!(charClass[(unsigned char)p[n]] & CLASS_DIGIT))
+            return PARSE_FORMAT_ERROR;
+    }
+    if (p[4] != ',')
+        return PARSE_FORMAT_ERROR;
+    short hour = (p[0] - '0') * 10 + (p[1] - '0');
+    short minutes = (p[2] - '0') * 10 + (p[3] - '0');
+    p += 5;
+
+    // Price: (0|[1-9][0-9]*)(\.[0-9]+)? accumulated as an integer and scaled once
+    unsigned long long mantissa = 0;
+    int digits = 0, decimals = 0;
+    if (p == end || !(charClass[(unsigned char)*p] & CLASS_DIGIT))
+        return PARSE_FORMAT_ERROR;
+    if (*p == '0'){
+        p++;
+    }else{
+        while (p < end && (charClass[(unsigned char)*p] & CLASS_DIGIT)){
+            if (digits < 18)
+                mantissa = mantissa * 10 + (*p - '0'), digits++;
+            else
+                decimals--;
+            p++;
+        }
+    }
+    if (p < end && *p == '.'){
+        p++;
+        if (p == end || !(charClass[(unsigned char)*p] & CLASS_DIGIT))
+            return PARSE_FORMAT_ERROR;
+        while (p < end && (charClass[(unsigned char)*p] & CLASS_DIGIT)){
+            if (digits < 18)
+                mantissa = mantissa * 10 + (*p - '0'), digits++, decimals++;
+            p++;
+        }
+    }
+    if (p == end || *p++ != ',')
+        return PARSE_FORMAT_ERROR;
+    double price = (double)mantissa;
+    for (; decimals > 0; decimals--)
+        price /= 10;
+    for (; decimals < 0; decimals++)
+        price *= 10;
+    record->price = (float)price;
+
+    // Stops: a single digit followed by a comma, anything after it is ignored
+    if (end - p < 2 || !(charClass[(unsigned char)p[0]] & CLASS_DIGIT) || p[1] != ',')
+        return PARSE_FORMAT_ERROR;
+    record->stops = p[0] - '0';
+
+    if (minutes > 59 || hour > 23)
+        return PARSE_TIME_ERROR;
+    record->departureHour = hour;
+    record->departureMinutes = minutes;
+    return PARSE_OK;
+}
+
+static int workers = 0;
+
+// Number of threads parallel work is split over, FLIGHTS_THREADS overrides the number of cores
+int workerCount(void){
+    if (workers == 0){
+        const char *env = getenv("FLIGHTS_THREADS");
+        setWorkerCount(env != NULL ? atoi(env) : (int)sysconf(_SC_NPROCESSORS_ONLN));
+    }
+    return workers;
+}
+
+void setWorkerCount(int n){
+    workers = n < 1 ? 1 : (n > MAX_WORKERS ? MAX_WORKERS : n);
+}
+
+// Tasks a worker has left, the owner takes them from the front and thieves split off the back half
+// lo and hi are packed in one word so that both ends change in a single compare and swap
+typedef struct taskRange{
+    atomic_ullong range;
+    char pad[64 - sizeof(atomic_ullong)];   // one cache line per worker
+}taskRange;
+
+#define PACK_RANGE(lo, hi) ((unsigned long long)(unsigned)(lo) << 32 | (unsigned)(hi))
+
+typedef struct parallelRun{
+    void (*task)(void *context, int index, int worker);
+    void *context;
+    int numWorkers;
+    taskRange ranges[MAX_WORKERS];
+}parallelRun;
+
+// Threads kept for the life of the program, started by the first run that needs them
+// Runs are posted one at a time, the calling thread works as worker 0
+typedef struct workPool{
+    pthread_mutex_t lock;
+    pthread_cond_t posted;      // a run was posted
+    pthread_cond_t idle;        // the last thread left the run
+    pthread_t threads[MAX_WORKERS];
+    int numThreads;
+    unsigned long generation;   // bumped by every run
+    parallelRun *run;
+    int busy;                   // threads still working on the run
+}workPool;
+
+static workPool pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER};
+static pthread_mutex_t runLock = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local bool inPool;
+
+int takeTask(taskRange *own){
+    unsigned long long range = atomic_load(&own->range);
+    while (1){
+        unsigned lo = range >> 32, hi = (unsigned)range;
+        if (lo >= hi)
+            return -1;
+        if (atomic_compare_exchange_weak(&own->range, &range, PACK_RANGE(lo + 1, hi)))
+            return lo;
+    }
+}
+
+// Move the back half of another worker's tasks to an empty own range, return false once every range is empty
+bool stealTasks(parallelRun *run, int worker){
+    for (int i = 1; i < run->numWorkers; i++){
+        taskRange *victim = &run->ranges[(worker + i) % run->numWorkers];
+        unsigned long long range = atomic_load(&victim->range);
+        while (1){
+            unsigned lo = range >> 32, hi = (unsigned)range;
+            if (lo >= hi)
+                break;
+            unsigned mid = lo + (hi - lo) / 2;
+            if (atomic_compare_exchange_weak(&victim->range, &range, PACK_RANGE(lo, mid))){
+                atomic_store(&run->ranges[worker].range, PACK_RANGE(mid, hi));
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void workOn(parallelRun *run, int worker){
+    while (1){
+        int index = takeTask(&run->ranges[worker]);
+        if (index >= 0)
+            run->task(run->context, index, worker);
+        else if (!stealTasks(run, worker))
+            return;
+    }
+}
+
+void *poolThread(void *arg){
+    int worker = (int)(long)arg;
+    unsigned long seen = 0;
+    inPool = true;
+    pthread_mutex_lock(&pool.lock);
+    while (1){
+        while (pool.generation == seen)
+            pthread_cond_wait(&pool.posted, &pool.lock);
+        seen = pool.generation;
+        parallelRun *run = pool.run;
+        if (worker >= run->numWorkers)
+            continue;
+        pthread_mutex_unlock(&pool.lock);
+        workOn(run, worker);
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.busy == 0)
+            pthread_cond_signal(&pool.idle);
+    }
+    return NULL;
+}
+
+// Run task for every index below numTasks on up to workerCount threads of the pool
+// Every worker starts on its own share of the indexes and steals from the others once it is done,
+// so uneven tasks still keep every thread busy. A task that runs tasks itself runs them on its own thread.
+void runParallel(int numTasks, void (*task)(void *context, int index, int worker), void *context){
+    int numWorkers = workerCount() < numTasks ? workerCount() : numTasks;
+    if (numWorkers <= 1 || inPool){
+        for (int i = 0; i < numTasks; i++)
+            task(context, i, 0);
+        return;
+    }
+    pthread_mutex_lock(&runLock);
+    // a thread that cannot be started leaves its share to the others
+    while (pool.numThreads < numWorkers - 1 &&
+           pthread_create(&pool.threads[pool.numThreads], NULL, poolThread, (void *)(long)(pool.numThreads + 1)) == 0)
+        pool.numThreads++;
+    numWorkers = pool.numThreads + 1 < numWorkers ? pool.numThreads + 1 : numWorkers;
+
+    parallelRun run;
+    run.task = task;
+    run.context = context;
+    run.numWorkers = numWorkers;
+    for (int w = 0; w < numWorkers; w++)
+        atomic_init(&run.ranges[w].range, PACK_RANGE((long)numTasks * w / numWorkers, (long)numTasks * (w + 1) / numWorkers));
+
+    pthread_mutex_lock(&pool.lock);
+    pool.run = &run;
+    pool.busy = numWorkers - 1;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.posted);
+    pthread_mutex_unlock(&pool.lock);
+
+    inPool = true;
+    workOn(&run, 0);
+    inPool = false;
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.busy > 0)
+        pthread_cond_wait(&pool.idle, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+    pthread_mutex_unlock(&runLock);
+}
+
+// End of the chunk starting at p, the line reaching past LOAD_CHUNK_BYTES is kept whole
+const char *chunkEnd(const char *p, const char *fileEnd){
+    if (fileEnd - p <= LOAD_CHUNK_BYTES)
+        return fileEnd;
+    const char *lineEnd = memchr(p + LOAD_CHUNK_BYTES, '\n', fileEnd - p - LOAD_CHUNK_BYTES);
+    return lineEnd == NULL ? fileEnd : lineEnd + 1;
+}
+
+// Parse the lines of a chunk into batch, the first line of the file is the header and is only counted
+// Parsing stops at the first bad line, numLines then counts the lines before it
+void parseLines(const char *p, const char *end, const char *fileEnd, bool header, loadBatch *batch){
+    batch->numRecords = 0;
+    batch->numLines = 0;
+    batch->status = PARSE_OK;
+    batch->bytes = end - p;
+    while (p < end){
+        const char *lineEnd = memchr(p, '\n', end - p);
+        if (lineEnd == NULL)
+            lineEnd = end;
+        const char *i = p;
+
+        //move to a non white space character
+        while (i < lineEnd && (charClass[(unsigned char)*i] & CLASS_SPACE)){
+            i++;
+        }
+        if (i == lineEnd){
+            // if the line only holds white space then dont count the line, unless it is a blank line
+            if (lineEnd != fileEnd)
+                batch->status = PARSE_BLANK_LINE;
+            return;
+        }
+
+        // first line is the header
+        if (!header || batch->numLines != 0){
+            if (batch->numRecords == batch->maxRecords){
+                batch->maxRecords = batch->maxRecords > 0 ? batch->maxRecords * 2 : 4096;
+                batch->records = (dataSet *)realloc(batch->records, batch->maxRecords * sizeof(dataSet));
+            }
+            int status = parseRecord(p, lineEnd, &batch->records[batch->numRecords]);
+            if (status != PARSE_OK){
+                batch->status = status;
+                return;
+            }
+            batch->numRecords++;
+        }
+        batch->numLines++;
+        p = lineEnd + 1;
+    }
+}
+
+// Report the bad line of a dataset and stop, line counts the lines before it
+void loadError(int status, int line){
+    endwin();
+    if (status == PARSE_BLANK_LINE)
+        fprintf(stderr, "Error: blank line at line %d of %s\n", line, FILENAME);
+    else if (status == PARSE_TIME_ERROR)
+        fprintf(stderr, "Error: Date Format Error at line %d of %s\n", line + 1, FILENAME);
+    else
+        fprintf(stderr, "Error: format error at line %d of %s\n", line + 1, FILENAME);
+    exit(EXIT_FAILURE);
+}
+
+// Map a dataset file, return NULL for an empty file
+const char *mapFile(FILE *fp, size_t *size){
+    struct stat st;
+    const char *data = NULL;
+    if (fstat(fileno(fp), &st) != 0){
+        perror("Error Reading File");
+        exit(EXIT_FAILURE);
+    }
+    if (st.st_size > 0){
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+        if (data == MAP_FAILED){
+            perror("Error Mapping File");
+            exit(EXIT_FAILURE);
+        }
+        madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+    }
+    *size = st.st_size;
+    return data;
+}
+
+// Chunks of a file loaded in parallel, in file order
+typedef struct loadChunk{
+    const char *start;
+    const char *end;
+    int numLines;       // lines of the chunk, or the lines before the bad one
+    int firstRow;       // row of the first record of the chunk
+    int numRecords;
+    int status;
+}loadChunk;
+
+typedef struct parallelLoad{
+    flightDB *db;
+    const char *data;
+    const char *fileEnd;
+    loadChunk *chunks;
+    loadBatch batches[MAX_WORKERS];     // records of the chunk a worker is parsing
+}parallelLoad;
+
+// Count the lines of a chunk so that every chunk knows its first row before any is parsed
+void countChunk(void *context, int index, int worker){
+    parallelLoad *load = (parallelLoad *)context;
+    loadChunk *chunk = &load->chunks[index];
+    const char *p = chunk->start;
+    int lines = 0;
+    while (p < chunk->end && (p = memchr(p, '\n', chunk->end - p)) != NULL){
+        lines++;
+        p++;
+    }
+    if (chunk->end > chunk->start && chunk->end[-1] != '\n')
+        lines++;
+    chunk->numLines = lines;
+    (void)worker;
+}
+
+// Parse a chunk and store its records in the rows counted for it, chunks write disjoint rows of the columns
+void parseChunk(void *context, int index, int worker){
+    parallelLoad *load = (parallelLoad *)context;
+    loadChunk *chunk = &load->chunks[index];
+    loadBatch *batch = &load->batches[worker];
+    parseLines(chunk->start, chunk->end, load->fileEnd, chunk->start == load->data, batch);
+    for (int i = 0; i < batch->numRecords; i++)
+        setRecord(load->db, chunk->firstRow + i, &batch->records[i]);
+    chunk->numRecords = batch->numRecords;
+    chunk->numLines = batch->numLines;
+    chunk->status = batch->status;
+}
+
+// Map the file into memory and load it into the columns, chunks are counted and then parsed on every core
+// and their rows follow the file order. Stop at the first bad line with its line number
+void loadFile(FILE *fp, flightDB *db){
+    int trueLine = 0, firstPosition = db->numRows, numChunks = 0, maxChunks = 64, numRecords = 0;
+    size_t size;
+    parallelLoad load;
+    memset(&load, 0, sizeof(load));
+
+    const char *data = mapFile(fp, &size);
+    initCharClass();
+    load.db = db;
+    load.data = data;
+    load.fileEnd = data + size;
+    load.chunks = (loadChunk *)malloc(maxChunks * sizeof(loadChunk));
+    for (const char *p = data; p < load.fileEnd; p = load.chunks[numChunks++].end){
+        if (numChunks == maxChunks){
+            maxChunks *= 2;
+            load.chunks = (loadChunk *)realloc(load.chunks, maxChunks * sizeof(loadChunk));
+        }
+        load.chunks[numChunks].start = p;
+        load.chunks[numChunks].end = chunkEnd(p, load.fileEnd);
+    }
+
+    // every line but the header is a record
+    runParallel(numChunks, countChunk, &load);
+    for (int i = 0; i < numChunks; i++){
+        load.chunks[i].firstRow = db->numSlots + numRecords;
+        numRecords += load.chunks[i].numLines - (i == 0 && load.chunks[i].numLines > 0);
+    }
+    reserveDB(db, db->numSlots + numRecords);
+    runParallel(numChunks, parseChunk, &load);
+    for (int i = 0; i < workerCount() && i < MAX_WORKERS; i++)
+        free(load.batches[i].records);
+
+    // the first bad line in file order is the one reported
+    numRecords = 0;
+    for (int i = 0; i < numChunks; i++){
+        if (load.chunks[i].status != PARSE_OK){
+            munmap((void *)data, size);
+            fclose(fp);
+            loadError(load.chunks[i].status, trueLine + load.chunks[i].numLines);
+        }
+        trueLine += load.chunks[i].numLines;
+        numRecords += load.chunks[i].numRecords;
+    }
+    free(load.chunks);
+    if (data != NULL){
+        munmap((void *)data, size);
+    }
+
+    // Display order of the rows already there followed by the loaded ones
+    int *rows = (int *)malloc((db->numRows + numRecords > 0 ? db->numRows + numRecords : 1) * sizeof(int));
+    orderRows(db, rows);
+    for (int i = 0; i < numRecords; i++)
+        rows[db->numRows + i] = db->numSlots + i;
+    db->numSlots += numRecords;
+    db->numRows += numRecords;
+    db->liveBytes += (size_t)numRecords * ROW_BYTES;
+    if (db->liveBytes > db->peakBytes)
+        db->peakBytes = db->liveBytes;
+    buildOrder(db, rows, db->numRows);
+    numberRows(db);
+    indexRows(db, rows + firstPosition, db->numRows - firstPosition);
+    free(rows);
+
+    fprintf(stderr, "File Structure is Correct! File has %d lines\n", trueLine);
+    fprintf(stderr, "Content Validation Successful!\n");
+}
+
+// Merge two sorted runs into out, taking from the left run on ties to stay stable
+void mergeRows(flightDB *db, int left[], int leftEnd, int right[], int rightEnd, int out[], sortKey keys[], int nKeys){
+    int i = 0, j = 0;
+    while (i < leftEnd && j < rightEnd)
+    {
+        if (compareKeys(db, left[i], right[j], keys, nKeys) <= 0)
+            *out++ = left[i++];
+        else
+            *out++ = right[j++];
+    }
+    while (i < leftEnd)
+        *out++ = left[i++];
+    while (j < rightEnd)
+        *out++ = right[j++];
+}
+
+// Bottom-up merge sort of rows, runs are merged back and forth between rows and temp
+// Equal rows keep their original order so the sort is stable, the result is left in rows
+void sortRows(flightDB *db, int rows[], int temp[], int n, sortKey keys[], int nKeys){
+    int *src = rows, *dst = temp;
+    for (int width = 1; width < n; width *= 2)
+    {
+        for (int start = 0; start < n; start += 2 * width)
+        {
+            int mid = start + width < n ? start + width : n;
+            int end = start + 2 * width < n ? start + 2 * width : n;
+            mergeRows(db, src + start, mid - start, src + mid, end - mid, dst + start, keys, nKeys);
+        }
+        int *swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != rows)
+        memcpy(rows, src, n * sizeof(int));
+}
+
+// Parallel merge sort, blocks are sorted on their own and then merged pairwise a round at a time
+// Every merge of a round is cut into pieces of about the same length so all the workers share it
+typedef struct parallelSort{
+    flightDB *db;
+    sortKey *keys;
+    int nKeys;
+    int *src;
+    int *dst;
+    int n;
+    int width;          // rows of a run in this round, blocks before the first round
+    int pieceRows;      // output rows of one merge piece
+    int piecesPerMerge;
+}parallelSort;
+
+void sortBlockTask(void *context, int index, int worker){
+    parallelSort *sort = (parallelSort *)context;
+    int start = index * sort->width, end = start + sort->width < sort->n ? start + sort->width : sort->n;
+    sortRows(sort->db, sort->src + start, sort->dst + start, end - start, sort->keys, sort->nKeys);
+    (void)worker;
+}
+
+// Number of rows of left that come before output position k when left and right are merged stably
+int coRank(parallelSort *sort, int k, int left[], int leftEnd, int right[], int rightEnd){
+    int lo = k > rightEnd ? k - rightEnd : 0, hi = k < leftEnd ? k : leftEnd;
+    while (lo < hi){
+        int i = lo + (hi - lo) / 2, j = k - i;
+        // left[i] belongs before output k when it does not come after right[j - 1]
+        if (j > 0 && compareKeys(sort->db, left[i], right[j - 1], sort->keys, sort->nKeys) <= 0)
+            lo = i + 1;
+        else
+            hi = i;
+    }
+    return lo;
+}
+
+void mergePieceTask(void *context, int index, int worker){
+    parallelSort *sort = (parallelSort *)context;
+    int start = index / sort->piecesPerMerge * 2 * sort->width, piece = index % sort->piecesPerMerge;
+    int mid = start + sort->width < sort->n ? start + sort->width : sort->n;
+    int end = start + 2 * sort->width < sort->n ? start + 2 * sort->width : sort->n;
+    int from = piece * sort->pieceRows, to = from + sort->pieceRows;
+    if (from >= end - start)
+        return;
+    if (to > end - start)
+        to = end - start;
+    int *left = sort->src + start, *right = sort->src + mid;
+    int i = coRank(sort, from, left, mid - start, right, end - mid);
+    int iEnd = coRank(sort, to, left, mid - start, right, end - mid);
+    mergeRows(sort->db, left + i, iEnd - i, right + (from - i), (to - iEnd) - (from - i),
+              sort->dst + start + from, sort->keys, sort->nKeys);
+    (void)worker;
+}
+
+// Sort rows with every worker, the order is the same as sortRows gives
+void sortRowsParallel(flightDB *db, int rows[], int temp[], int n, sortKey keys[], int nKeys){
+    int numWorkers = workerCount();
+    parallelSort sort = {db, keys, nKeys, rows, temp, n, 0, 0, 0};
+    // a few blocks per worker so a slow block does not hold up the others
+    int numBlocks = numWorkers * 4;
+    sort.width = (n + numBlocks - 1) / numBlocks;
+    runParallel((n + sort.width - 1) / sort.width, sortBlockTask, &sort);
+
+    sort.pieceRows = (n + numBlocks - 1) / numBlocks;
+    for (; sort.width < n; sort.width *= 2){
+        int numMerges = (n + 2 * sort.width - 1) / (2 * sort.width);
+        sort.piecesPerMerge = (2 * sort.width + sort.pieceRows - 1) / sort.pieceRows;
+        runParallel(numMerges * sort.piecesPerMerge, mergePieceTask, &sort);
+        int *swap = sort.src;
+        sort.src = sort.dst;
+        sort.dst = swap;
+    }
+    if (sort.src != rows)
+        memcpy(rows, sort.src, n * sizeof(int));
+}
+
+// Fill keys with a number per row that orders like compareAttribute does, return false for attributes without one
+// Airport codes pack into their alphabetical order, signed values are offset and price uses the bits of the float
+bool radixKeys(flightDB *db, int rows[], int n, sortKey key, unsigned int keys[]){
+    switch (key.attribute)
+    {
+    case 2:
+        for (int i = 0; i < n; i++)
+            keys[i] = db->origin[rows[i]];
+        break;
+    case 3:
+        for (int i = 0; i < n; i++)
+            keys[i] = db->destination[rows[i]];
+        break;
+    case 4:
+        for (int i = 0; i < n; i++)
+            keys[i] = (unsigned int)db->capacity[rows[i]] ^ 0x80000000u;
+        break;
+    case 5:
+        for (int i = 0; i < n; i++)
+            keys[i] = (unsigned int)(db->departureHour[rows[i]] * 60 + db->departureMinutes[rows[i]]) ^ 0x80000000u;
+        break;
+    case 6:
+        for (int i = 0; i < n; i++){
+            float price = db->price[rows[i]];
+            unsigned int bits;
+            // -0 equals 0 for compareAttribute
+            if (price == 0)
+                price = 0;
+            memcpy(&bits, &price, sizeof(bits));
+            keys[i] = bits & 0x80000000u ? ~bits : bits | 0x80000000u;
+        }
+        break;
+    case 7:
+        for (int i = 0; i < n; i++)
+            keys[i] = (unsigned int)db->stops[rows[i]] ^ 0x80000000u;
+        break;
+    default:
+        return false;
+    }
+    if (key.descending){
+        for (int i = 0; i < n; i++)
+            keys[i] = ~keys[i];
+    }
+    return true;
+}
+
+// Stable LSD radix sort of rows by keys, a digit every key shares is skipped
+// so stops and departure time take a single counting pass
+void radixSortRows(unsigned int keys[], unsigned int keyTemp[], int rows[], int temp[], int n){
+    int counts[(32 + RADIX_BITS - 1) / RADIX_BITS][1 << RADIX_BITS];
+    int numDigits = (32 + RADIX_BITS - 1) / RADIX_BITS, mask = (1 << RADIX_BITS) - 1;
+    int *src = rows, *dst = temp;
+    unsigned int *keySrc = keys, *keyDst = keyTemp;
+    memset(counts, 0, sizeof(counts));
+    for (int i = 0; i < n; i++){
+        for (int digit = 0; digit < numDigits; digit++)
+            counts[digit][keys[i] >> (digit * RADIX_BITS) & mask]++;
+    }
+    int lastDigit = -1;
+    for (int digit = 0; digit < numDigits; digit++){
+        if (counts[digit][keys[0] >> (digit * RADIX_BITS) & mask] != n)
+            lastDigit = digit;
+    }
+    for (int digit = 0; digit <= lastDigit; digit++){
+        int shift = digit * RADIX_BITS, *count = counts[digit];
+        if (count[keySrc[0] >> shift & mask] == n)
+            continue;
+        for (int bucket = 0, position = 0; bucket <= mask; bucket++){
+            int c = count[bucket];
+            count[bucket] = position;
+            position += c;
+        }
+        // the keys are not needed after the last pass
+        if (digit == lastDigit){
+            for (int i = 0; i < n; i++)
+                dst[count[keySrc[i] >> shift & mask]++] = src[i];
+        }else{
+            for (int i = 0; i < n; i++){
+                int position = count[keySrc[i] >> shift & mask]++;
+                dst[position] = src[i];
+                keyDst[position] = keySrc[i];
+            }
+        }
+        int *swap = src;
+        src = dst;
+        dst = swap;
+        unsigned int *keySwap = keySrc;
+        keySrc = keyDst;
+        keyDst = keySwap;
+    }
+    if (src != rows)
+        memcpy(rows, src, n * sizeof(int));
+}
+
+// Sort by keys that all have radix keys, the last key first so that every stable pass keeps the order of the keys after it
+bool sortRowsRadix(flightDB *db, int rows[], int temp[], int n, sortKey keys[], int nKeys){
+    for (int k = 0; k < nKeys; k++){
+        if (keys[k].attribute < 2 || keys[k].attribute > 7)
+            return false;
+    }
+    unsigned int *keyA = (unsigned int *)malloc(n * sizeof(unsigned int));
+    unsigned int *keyB = (unsigned int *)malloc(n * sizeof(unsigned int));
+    for (int k = nKeys - 1; k >= 0; k--){
+        radixKeys(db, rows, n, keys[k], keyA);
+        radixSortRows(keyA, keyB, rows, temp, n);
+    }
+    free(keyA);
+    free(keyB);
+    return true;
+}
+
+// Live rows in sequence order, the order every sort starts from so that equal keys keep it
+void sequenceRows(flightDB *db, int rows[], int temp[]){
+    int n = db->numRows;
+    bool sorted = true;
+    orderRows(db, rows);
+    for (int i = 1; i < n && sorted; i++)
+        sorted = db->sequence[rows[i - 1]] < db->sequence[rows[i]];
+    if (sorted)
+        return;
+    unsigned int *keys = (unsigned int *)malloc(n * sizeof(unsigned int));
+    unsigned int *keyTemp = (unsigned int *)malloc(n * sizeof(unsigned int));
+    for (int i = 0; i < n; i++)
+        keys[i] = db->sequence[rows[i]];
+    radixSortRows(keys, keyTemp, rows, temp, n);
+    free(keys);
+    free(keyTemp);
+}
+
+// Stable sort of a list of rows on keys, radix sorted when the keys allow it and on every core when the list is large
+void sortRowList(flightDB *db, int rows[], int temp[], int n, sortKey keys[], int nKeys){
+    if (!sortRowsRadix(db, rows, temp, n, keys, nKeys)){
+        if (n >= PARALLEL_SORT_ROWS && workerCount() > 1)
+            sortRowsParallel(db, rows, temp, n, keys, nKeys);
+        else
+            sortRows(db, rows, temp, n, keys, nKeys);
+    }
+}
+
+// Sort the live rows on keys into rows, equal keys keep their sequence order
+void sortedRows(flightDB *db, int rows[], int temp[], sortKey keys[], int nKeys){
+    sequenceRows(db, rows, temp);
+    sortRowList(db, rows, temp, db->numRows, keys, nKeys);
+}
+
+// Built view with the order of key, sorted or range view, NULL when there is none
+sortView *findView(flightDB *db, sortKey key){
+    for (int i = 0; i < SORT_VIEWS + RANGE_VIEWS; i++){
+        if (db->views[i].usedAt != 0 && db->views[i].key.attribute == key.attribute &&
+            db->views[i].key.descending == key.descending)
+            return &db->views[i];
+    }
+    return NULL;
+}
+
+// Sort the display order on keys, equal keys keep the sequence order of their rows
+// The order of a single key is kept as a view that edits keep up to date, sorting on that key again only copies it
+// Numeric and airport code keys are radix sorted and large tables are sorted on every core, with the same result either way
+void sortDBKeys(flightDB *db, sortKey keys[], int nKeys)
+{
+    int n = db->numRows;
+    if (n < 2 || nKeys <= 0){
+        return;
+    }
+    int *rows = (int *)malloc(n * sizeof(int));
+    int *temp = (int *)malloc(n * sizeof(int));
+    sortView *view = nKeys == 1 ? findView(db, keys[0]) : NULL;
+    if (view != NULL){
+        treeRows(&view->tree, rows);
+    }else{
+        sortedRows(db, rows, temp, keys, nKeys);
+        if (nKeys == 1){
+            // replace the least recently used view
+            view = &db->views[0];
+            for (int i = 1; i < SORT_VIEWS; i++){
+                if (db->views[i].usedAt < view->usedAt)
+                    view = &db->views[i];
+            }
+            view->key = keys[0];
+            buildTree(db, &view->tree, rows, n);
+        }
+    }
+    if (view != NULL)
+        view->usedAt = ++db->viewClock;
+    buildOrder(db, rows, n);
+    free(rows);
+    free(temp);
+    logSort(db, keys, nKeys);
+}
+
+// Sort on a single attribute, option 1-7 controls what to be sorted
+void sortDB(flightDB *db, int option)
+{
+    sortKey key = {option, false};
+    sortDBKeys(db, &key, 1);
+}
+
+// Make room for at least numRows rows in a search result, counted in the search memory counters
+void reserveSearch(flightDB *db, searchResult *result, int numRows){
+    if (numRows <= result->maxRows){
+        return;
+    }
+    int maxRows = result->maxRows > 0 ? result->maxRows : 64;
+    while (maxRows < numRows){
+        maxRows *= 2;
+    }
+    result->rows = realloc(result->rows, maxRows * sizeof(int));
+    if (result->rows == NULL){
+        endwin();
+        fprintf(stderr, "Error: out of memory for %d search results\n", maxRows);
+        exit(EXIT_FAILURE);
+    }
+    db->searchBytes += (size_t)(maxRows - result->maxRows) * sizeof(int);
+    if (db->searchBytes > db->peakSearchBytes)
+        db->peakSearchBytes = db->searchBytes;
+    result->maxRows = maxRows;
+}
+
+// Add a row at the tail of a search result
+void appendSearch(flightDB *db, searchResult *result, int row){
+    reserveSearch(db, result, result->numRows + 1);
+    result->rows[result->numRows++] = row;
+}
+
+int comparePositions(const void *a, const void *b){
+    return (*(const int *)a > *(const int *)b) - (*(const int *)a < *(const int *)b);
+}
+
+// Turn the rows found by an index into a search result in display order, return number of rows
+// A few rows are sorted by position, when most of the table matched a pass over order is cheaper
+int collectSearch(flightDB *db, int rows[], int numRows, searchResult *result){
+    result->numRows = 0;
+    reserveSearch(db, result, numRows);
+
+    if (numRows > db->numRows / 8){
+        bool *matched = (bool *)calloc(db->numSlots > 0 ? db->numSlots : 1, sizeof(bool));
+        for (int i = 0; i < numRows; i++)
+            matched[rows[i]] = true;
+        int slot;
+        for (orderNode *leaf = seekOrder(db, 0, &slot); leaf != NULL; leaf = leaf->next){
+            for (slot = 0; slot < leaf->numItems; slot++){
+                if (matched[leaf->rows[slot]])
+                    result->rows[result->numRows++] = leaf->rows[slot];
+            }
+        }
+        free(matched);
+    }else{
+        for (int i = 0; i < numRows; i++)
+            rows[i] = positionOf(db, rows[i]);
+        qsort(rows, numRows, sizeof(int), comparePositions);
+        for (int i = 0; i < numRows; i++)
+            result->rows[result->numRows++] = rowAt(db, rows[i]);
+    }
+    return result->numRows;
+}
+
+// Gather the rows of every airport code containing input from the origin or destination posting lists
+int searchCodes(flightDB *db, char input[], searchResult *result, bool byOrigin){
+    routeIndex *index = &db->routeIdx;
+    int numMatches = 0;
+    for (int id = 0; id < index->codeIds.numIds; id++){
+        if (strstr(index->codes[id], input) != NULL)
+            numMatches += byOrigin ? index->byOrigin[id].numRows : index->byDestination[id].numRows;
+    }
+    int *rows = (int *)malloc((numMatches > 0 ? numMatches : 1) * sizeof(int));
+    numMatches = 0;
+    for (int id = 0; id < index->codeIds.numIds; id++){
+        if (strstr(index->codes[id], input) == NULL)
+            continue;
+        postingList *list = byOrigin ? &index->byOrigin[id] : &index->byDestination[id];
+        if (list->numRows == 0)
+            continue;
+        memcpy(rows + numMatches, list->rows, list->numRows * sizeof(int));
+        numMatches += list->numRows;
+    }
+    numMatches = collectSearch(db, rows, numMatches, result);
+    free(rows);
+    return numMatches;
+}
+
+// Flight number substring search through the trigram index
+// The shortest candidate list is intersected with the others and what is left is verified with strstr
+// Queries shorter than a trigram scan the distinct flight numbers of the hash index instead of every row
+int searchFlights(flightDB *db, char input[], searchResult *result){
+    int length = strlen(input);
+    int numMatches = 0;
+    int *rows = NULL;
+
+    result->numRows = 0;
+    if (length >= (int)sizeof(db->flightNumber[0]))
+        return 0;
+    if (length < 3){
+        flightIndex *index = &db->flightIdx;
+        int maxMatches = 64;
+        rows = (int *)malloc(maxMatches * sizeof(int));
+        for (int bucket = 0; bucket < index->numBuckets; bucket++){
+            int head = index->heads[bucket];
+            if (head == EMPTY_BUCKET || strstr(db->flightNumber[head], input) == NULL)
+                continue;
+            for (int row = head; row != EMPTY_BUCKET; row = index->nextRow[row]){
+                if (numMatches == maxMatches){
+                    maxMatches *= 2;
+                    rows = (int *)realloc(rows, maxMatches * sizeof(int));
+                }
+                rows[numMatches++] = row;
+            }
+        }
+    }else{
+        gramIndex *index = &db->gramIdx;
+        postingList *lists[20];
+        int numLists = length - 2, shortest = 0;
+        for (int i = 0; i < numLists; i++){
+            int id = lookupId(&index->gramIds, packGram(input + i), false);
+            if (id == EMPTY_BUCKET || index->byGram[id].numRows == 0)
+                return 0;
+            lists[i] = &index->byGram[id];
+            if (lists[i]->numRows < lists[shortest]->numRows)
+                shortest = i;
+        }
+        rows = (int *)malloc(lists[shortest]->numRows * sizeof(int));
+        for (int j = 0; j < lists[shortest]->numRows; j++){
+            int row = lists[shortest]->rows[j];
+            bool candidate = true;
+            for (int i = 0; i < numLists && candidate; i++){
+                if (i == shortest)
+                    continue;
+                int slot = lowerBound(lists[i], row);
+                candidate = slot < lists[i]->numRows && lists[i]->rows[slot] == row;
+            }
+            // Having every trigram does not mean they are adjacent, verify the candidate
+            if (candidate && strstr(db->flightNumber[row], input) != NULL)
+                rows[numMatches++] = row;
+        }
+    }
+    numMatches = collectSearch(db, rows, numMatches, result);
+    free(rows);
+    return numMatches;
+}
+
+// Substring search, return number of matches found
+// Use optiion to control what to search 1: Flight Number, 2: Origin, 3: Destination
+// Flight numbers go through the trigram index, airport codes go through the route index
+int searchDB(flightDB *db, char input[], searchResult *result, int option){
+    int numMatches = 0;
+    result->numRows = 0;
+    ensureIndexes(db);
+
+    switch (option)
+    {
+    case 1:
+        numMatches = searchFlights(db, input, result);
+        break;
+    case 2:
+        numMatches = searchCodes(db, input, result, true);
+        break;
+    case 3:
+        numMatches = searchCodes(db, input, result, false);
+        break;
+    default:
+        break;
+    }
+    return numMatches;
+}
+
+// Text of a string attribute of a row, option 1: Flight Number, 2: Origin, 3: Destination, codes are unpacked into code
+char *fieldText(flightDB *db, int row, int option, char code[5]){
+    if (option == 1)
+        return db->flightNumber[row];
+    unpackCode(option == 2 ? db->origin[row] : db->destination[row], code);
+    return code;
+}
+
+// Narrow the result of a shorter query down to the rows matching input, return number of matches found
+// Every row containing input also contains any prefix of it, so only the previous matches are visited and their order is kept
+int narrowSearch(flightDB *db, searchResult *from, char input[], searchResult *result, int option){
+    result->numRows = 0;
+    for (int i = 0; i < from->numRows; i++){
+        char code[5];
+        if (strstr(fieldText(db, from->rows[i], option, code), input) != NULL)
+            appendSearch(db, result, from->rows[i]);
+    }
+    return result->numRows;
+}
+
+// Split a route typed as "KUL HND", "KUL-HND" or just "KUL" into its airport codes
+bool parseRoute(char input[], char origin[5], char destination[5]){
+    char *codes[2] = {origin, destination};
+    char *p = input;
+    for (int c = 0; c < 2; c++){
+        int n = 0;
+        while (*p == ' ' || *p == '-' || *p == '>' || *p == ',')
+            p++;
+        while (*p >= 'A' && *p <= 'Z'){
+            if (n == 4)
+                return false;
+            codes[c][n++] = *p++;
+        }
+        codes[c][n] = '\0';
+    }
+    while (*p == ' ')
+        p++;
+    return origin[0] != '\0' && *p == '\0';
+}
+
+// Exact origin->destination lookup through the route index, return number of matches found
+// An empty destination lists every flight leaving origin
+int searchRouteDB(flightDB *db, char origin[], char destination[], searchResult *result){
+    routeIndex *index = &db->routeIdx;
+    postingList *list = NULL;
+    result->numRows = 0;
+    ensureIndexes(db);
+
+    int originId = lookupId(&index->codeIds, packCode(origin), false);
+    if (originId == EMPTY_BUCKET)
+        return 0;
+    if (destination[0] == '\0'){
+        list = &index->byOrigin[originId];
+    }else{
+        int destinationId = lookupId(&index->codeIds, packCode(destination), false);
+        if (destinationId == EMPTY_BUCKET)
+            return 0;
+        int route = lookupId(&index->routeIds, (unsigned long long)originId << 32 | destinationId, false);
+        if (route == EMPTY_BUCKET)
+            return 0;
+        list = &index->byRoute[route];
+    }
+    if (list->numRows == 0)
+        return 0;
+    int *rows = (int *)malloc(list->numRows * sizeof(int));
+    memcpy(rows, list->rows, list->numRows * sizeof(int));
+    int numMatches = collectSearch(db, rows, list->numRows, result);
+    free(rows);
+    return numMatches;
+}
+
+// Exact flight number lookup through the hash index, return number of matches found
+// Only the chain of the flight number is visited
+int searchExactDB(flightDB *db, char input[], searchResult *result){
+    flightIndex *index = &db->flightIdx;
+    int numMatches = 0;
+    result->numRows = 0;
+    ensureIndexes(db);
+    if (index->numBuckets == 0)
+        return 0;
+
+    int maxMatches = 16;
+    int *rows = (int *)malloc(maxMatches * sizeof(int));
+    for (int row = index->heads[findFlight(db, input, hashFlight(input))]; row != EMPTY_BUCKET; row = index->nextRow[row]){
+        if (numMatches == maxMatches){
+            maxMatches *= 2;
+            rows = (int *)realloc(rows, maxMatches * sizeof(int));
+        }
+        rows[numMatches++] = row;
+    }
+    numMatches = collectSearch(db, rows, numMatches, result);
+    free(rows);
+    return numMatches;
+}
+
+// Read one bound of a range, return the end of it or p when there is none
+char *readBound(char *p, int option, double *value){
+    char *end = p;
+    if (option == 5){
+        short hour, minutes;
+        int digits = 0;
+        // stop at the first character that is not a digit, a short bound never reads past its terminator
+        while (digits < 4 && (charClass[(unsigned char)p[digits]] & CLASS_DIGIT))
+            digits++;
+        if (digits == 4 && validateTime(p, &hour, &minutes)){
+            *value = hour * 60 + minutes;
+            end = p + 4;
+        }
+    }else if (charClass[(unsigned char)*p] & CLASS_DIGIT){
+        *value = strtod(p, &end);
+    }
+    return end;
+}
+
+// Split a range typed as "100-250", "300-", "-90" or a single value into its bounds
+// Departure times are typed as 0700, an open end is left at -HUGE_VAL or HUGE_VAL
+bool parseRange(char input[], int option, double *low, double *high){
+    char *p = input + strspn(input, " ");
+    char *end = readBound(p, option, low);
+    bool hasLow = end != p;
+    p = end + strspn(end, " ");
+    if (*p != '-'){
+        *high = *low;
+        return hasLow && *p == '\0';
+    }
+    p += 1 + strspn(p + 1, " ");
+    end = readBound(p, option, high);
+    bool hasHigh = end != p;
+    p = end + strspn(end, " ");
+    if (!hasLow)
+        *low = -HUGE_VAL;
+    if (!hasHigh)
+        *high = HUGE_VAL;
+    return (hasLow || hasHigh) && *p == '\0';
+}
+
+// Value of a numeric attribute compared by range searches, departure time in minutes of the day
+double rangeValue(flightDB *db, int row, int option){
+    switch (option)
+    {
+    case 4:
+        return db->capacity[row];
+    case 5:
+        return db->departureHour[row] * 60 + db->departureMinutes[row];
+    case 6:
+        return db->price[row];
+    default:
+        return db->stops[row];
+    }
+}
+
+typedef struct rangeTarget{
+    int option;
+    double value;
+    bool inclusive;     // rows equal to value come before it
+}rangeTarget;
+
+bool valueBefore(flightDB *db, int row, void *target){
+    rangeTarget *t = (rangeTarget *)target;
+    double value = rangeValue(db, row, t->option);
+    return value < t->value || (t->inclusive && value == t->value);
+}
+
+// Rows whose attribute lies between low and high inclusive, return number of matches found
+// Option 4: Capacity, 5: Departure Time in minutes, 6: Price, 7: Stops
+// The range view of the attribute is built by the first search, then both ends are found in O(log n) and the k rows between them copied
+int searchRangeDB(flightDB *db, int option, double low, double high, searchResult *result){
+    result->numRows = 0;
+    if (option < FIRST_RANGE_ATTRIBUTE || option >= FIRST_RANGE_ATTRIBUTE + RANGE_VIEWS || low > high)
+        return 0;
+    if (option == 6){
+        // prices are stored as floats, a typed 100.1 has to match the stored one
+        low = (float)low;
+        high = (float)high;
+    }
+    sortView *view = &db->views[SORT_VIEWS + option - FIRST_RANGE_ATTRIBUTE];
+    if (view->usedAt == 0){
+        sortKey key = {option, false};
+        sortView *sorted = findView(db, key);
+        int n = db->numRows;
+        int *rows = (int *)malloc((n > 0 ? n : 1) * sizeof(int));
+        if (sorted != NULL){
+            treeRows(&sorted->tree, rows);
+        }else{
+            int *temp = (int *)malloc((n > 0 ? n : 1) * sizeof(int));
+            sortedRows(db, rows, temp, &key, 1);
+            free(temp);
+        }
+        view->key = key;
+        buildTree(db, &view->tree, rows, n);
+        view->usedAt = ++db->viewClock;
+        free(rows);
+    }
+
+    rangeTarget first = {option, low, false}, last = {option, high, true};
+    int from = treeRank(db, &view->tree, valueBefore, &first);
+    int to = treeRank(db, &view->tree, valueBefore, &last);
+    if (from >= to)
+        return 0;
+    reserveSearch(db, result, to - from);
+    sliceTree(&view->tree, from, to, result->rows);
+    result->numRows = to - from;
+    return result->numRows;
+}
+
+// Queries
+
+// Attribute names of a query in the 1-7 numbering of sortDB, "time" also names the departure time
+static const char *queryAttributes[] = {"", "flight", "origin", "destination", "capacity", "departure", "price", "stops"};
+static const char *queryOperators[] = {"", "=", "!=", "<", "<=", ">", ">=", "~"};
+
+// Take a keyword if it comes next, whatever its case
+bool takeWord(char **p, const char *word){
+    char *s = *p + strspn(*p, " ");
+    int length = strlen(word);
+    if (strncasecmp(s, word, length) != 0 || isalnum((unsigned char)s[length]))
+        return false;
+    *p = s + length;
+    return true;
+}
+
+// Take an attribute name, return its number or 0
+int takeAttribute(char **p){
+    char *s = *p + strspn(*p, " ");
+    int length = 0;
+    while (isalpha((unsigned char)s[length]))
+        length++;
+    for (int i = 1; i < 8; i++){
+        if ((int)strlen(queryAttributes[i]) == length && strncasecmp(s, queryAttributes[i], length) == 0){
+            *p = s + length;
+            return i;
+        }
+    }
+    if (length == 4 && strncasecmp(s, "time", 4) == 0){
+        *p = s + length;
+        return 5;
+    }
+    return 0;
+}
+
+int addNode(query *q, int op, int left, int right){
+    if (q->numNodes == QUERY_NODES)
+        return -1;
+    queryNode *node = &q->nodes[q->numNodes];
+    memset(node, 0, sizeof(queryNode));
+    node->op = op;
+    node->left = left;
+    node->right = right;
+    return q->numNodes++;
+}
+
+// attribute, operator and value, a flight number with a blank in it is quoted: flight="AK 123"
+int parseComparison(query *q, char **p){
+    int attribute = takeAttribute(p);
+    if (attribute == 0)
+        return -1;
+    char *s = *p + strspn(*p, " ");
+    int op = 0;
+    for (int i = QUERY_EQ; i <= QUERY_CONTAINS; i++){
+        if (strncmp(s, queryOperators[i], strlen(queryOperators[i])) == 0 && (op == 0 || strlen(queryOperators[i]) > strlen(queryOperators[op])))
+            op = i;
+    }
+    if (op == 0)
+        return -1;
+    s += strlen(queryOperators[op]);
+    s += strspn(s, " ");
+    int node = addNode(q, op, -1, -1);
+    if (node < 0)
+        return -1;
+    queryNode *n = &q->nodes[node];
+    n->attribute = attribute;
+    if (attribute <= 3){
+        char *end = *s == '"' ? strchr(s + 1, '"') : s + strcspn(s, " ()");
+        char *text = *s == '"' ? s + 1 : s;
+        if (end == NULL || end == text || end - text >= (int)sizeof(n->text))
+            return -1;
+        memcpy(n->text, text, end - text);
+        n->text[end - text] = '\0';
+        s = *end == '"' ? end + 1 : end;
+        // airport codes are compared packed, so they have at most 4 letters
+        if (attribute != 1 && op != QUERY_CONTAINS && end - text > 4)
+            return -1;
+        n->code = packCode(n->text);
+    }else{
+        double value;
+        char *end = readBound(s, attribute, &value);
+        if (end == s || op == QUERY_CONTAINS)
+            return -1;
+        // prices are stored as floats, comparing floats makes a typed 100.1 match the stored one
+        n->value = (float)value;
+        s = end;
+    }
+    *p = s;
+    return node;
+}
+
+int parseOr(query *q, char **p);
+
+int parsePrimary(query *q, char **p){
+    char *s = *p + strspn(*p, " ");
+    if (*s != '(')
+        return parseComparison(q, p);
+    *p = s + 1;
+    int node = parseOr(q, p);
+    s = *p + strspn(*p, " ");
+    if (node < 0 || *s != ')')
+        return -1;
+    *p = s + 1;
+    return node;
+}
+
+int parseAnd(query *q, char **p){
+    int node = parsePrimary(q, p);
+    while (node >= 0 && takeWord(p, "AND")){
+        int right = parsePrimary(q, p);
+        node = right < 0 ? -1 : addNode(q, QUERY_AND, node, right);
+    }
+    return node;
+}
+
+int parseOr(query *q, char **p){
+    int node = parseAnd(q, p);
+    while (node >= 0 && takeWord(p, "OR")){
+        int right = parseAnd(q, p);
+        node = right < 0 ? -1 : addNode(q, QUERY_OR, node, right);
+    }
+    return node;
+}
+
+// Parse a query: comparisons joined by AND and OR with parentheses, then ORDER BY attributes with DESC and LIMIT
+// e.g. origin=KUL AND (stops=0 OR price<300) ORDER BY departure DESC, price LIMIT 50
+bool parseQuery(char input[], query *q){
+    char *p = input;
+    q->numNodes = 0;
+    q->nKeys = 0;
+    q->limit = -1;
+    q->root = parseOr(q, &p);
+    if (q->root < 0)
+        return false;
+    if (takeWord(&p, "ORDER")){
+        if (!takeWord(&p, "BY"))
+            return false;
+        do{
+            int attribute = takeAttribute(&p);
+            if (attribute == 0 || q->nKeys == 7)
+                return false;
+            q->keys[q->nKeys].attribute = attribute;
+            q->keys[q->nKeys].descending = takeWord(&p, "DESC");
+            if (!q->keys[q->nKeys].descending)
+                takeWord(&p, "ASC");
+            q->nKeys++;
+            p += strspn(p, " ");
+        }while (*p == ',' && p++);
+    }
+    if (takeWord(&p, "LIMIT")){
+        char *end;
+        long limit = strtol(p, &end, 10);
+        if (end == p || limit < 0 || limit > INT_MAX)
+            return false;
+        q->limit = (int)limit;
+        p = end;
+    }
+    return p[strspn(p, " ")] == '\0';
+}
+
+// Whether the result of a comparison passes the operator
+bool passes(int op, int result){
+    switch (op)
+    {
+    case QUERY_EQ:
+        return result == 0;
+    case QUERY_NE:
+        return result != 0;
+    case QUERY_LT:
+        return result < 0;
+    case QUERY_LE:
+        return result <= 0;
+    case QUERY_GT:
+        return result > 0;
+    default:
+        return result >= 0;
+    }
+}
+
+// Whether a row passes a comparison
+bool matchComparison(flightDB *db, queryNode *n, int row){
+    if (n->op == QUERY_CONTAINS){
+        char code[5];
+        return strstr(fieldText(db, row, n->attribute, code), n->text) != NULL;
+    }
+    if (n->attribute == 1)
+        return passes(n->op, strcmp(db->flightNumber[row], n->text));
+    if (n->attribute <= 3){
+        unsigned int code = n->attribute == 2 ? db->origin[row] : db->destination[row];
+        return passes(n->op, (code > n->code) - (code < n->code));
+    }
+    float value = (float)rangeValue(db, row, n->attribute);
+    return passes(n->op, (value > n->value) - (value < n->value));
+}
+
+// Whether a row matches a node, for the rows an index lists
+bool matchRow(flightDB *db, query *q, int node, int row){
+    queryNode *n = &q->nodes[node];
+    if (n->op == QUERY_AND)
+        return matchRow(db, q, n->left, row) && matchRow(db, q, n->right, row);
+    if (n->op == QUERY_OR)
+        return matchRow(db, q, n->left, row) || matchRow(db, q, n->right, row);
+    return matchComparison(db, n, row);
+}
+
+// The scan loops are written for the vectorizer, which at -O2 only takes loops it finds trivially profitable
+#pragma GCC push_options
+#pragma GCC optimize ("vect-cost-model=cheap")
+
+// Values of a numeric attribute for count slots from base, as floats so that every attribute shares the compare loops
+void loadBlock(flightDB *db, int attribute, int base, int count, float values[64]){
+    switch (attribute)
+    {
+    case 4:
+        for (int j = 0; j < count; j++)
+            values[j] = db->capacity[base + j];
+        break;
+    case 5:
+        for (int j = 0; j < count; j++)
+            values[j] = db->departureHour[base + j] * 60 + db->departureMinutes[base + j];
+        break;
+    case 6:
+        for (int j = 0; j < count; j++)
+            values[j] = db->price[base + j];
+        break;
+    default:
+        for (int j = 0; j < count; j++)
+            values[j] = db->stops[base + j];
+        break;
+    }
+}
+
+// One byte per value, 1 when it passes, with a loop of fixed length and no branches that the compiler vectorizes
+void compareBlock(int op, const float values[64], float value, unsigned char pass[64]){
+    switch (op)
+    {
+    case QUERY_EQ:
+        for (int j = 0; j < 64; j++)
+            pass[j] = values[j] == value;
+        break;
+    case QUERY_NE:
+        for (int j = 0; j < 64; j++)
+            pass[j] = values[j] != value;
+        break;
+    case QUERY_LT:
+        for (int j = 0; j < 64; j++)
+            pass[j] = values[j] < value;
+        break;
+    case QUERY_LE:
+        for (int j = 0; j < 64; j++)
+            pass[j] = values[j] <= value;
+        break;
+    case QUERY_GT:
+        for (int j = 0; j < 64; j++)
+            pass[j] = values[j] > value;
+        break;
+    default:
+        for (int j = 0; j < 64; j++)
+            pass[j] = values[j] >= value;
+        break;
+    }
+}
+
+// Pack 64 bytes of 0 and 1 into a word, eight at a time with a multiply that gathers the low bit of each byte (little endian)
+unsigned long long packBits(const unsigned char pass[64]){
+    unsigned long long word = 0;
+    for (int b = 0; b < 8; b++){
+        unsigned long long bytes;
+        memcpy(&bytes, pass + b * 8, 8);
+        word |= (bytes * 0x0102040810204080ULL >> 56) << (b * 8);
+    }
+    return word;
+}
+
+#pragma GCC pop_options
+
+// Equality scans of packed airport codes, 64 slots per word of the bitmap
+
+void matchCodesScalar(const unsigned int codes[], int n, unsigned int code, unsigned long long bits[]){
+    for (int base = 0; base < n; base += 64){
+        int count = n - base < 64 ? n - base : 64;
+        unsigned long long word = 0;
+        for (int j = 0; j < count; j++)
+            word |= (unsigned long long)(codes[base + j] == code) << j;
+        bits[base / 64] = word;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// 4 codes per compare, movemask takes the top bit of each lane into the word
+__attribute__((target("sse2")))
+void matchCodesSSE2(const unsigned int codes[], int n, unsigned int code, unsigned long long bits[]){
+    __m128i key = _mm_set1_epi32((int)code);
+    int base = 0;
+    for (; base + 64 <= n; base += 64){
+        unsigned long long word = 0;
+        for (int j = 0; j < 64; j += 4){
+            __m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(codes + base + j)), key);
+            word |= (unsigned long long)_mm_movemask_ps(_mm_castsi128_ps(equal)) << j;
+        }
+        bits[base / 64] = word;
+    }
+    matchCodesScalar(codes + base, n - base, code, bits + base / 64);
+}
+
+// 8 codes per compare
+__attribute__((target("avx2")))
+void matchCodesAVX2(const unsigned int codes[], int n, unsigned int code, unsigned long long bits[]){
+    __m256i key = _mm256_set1_epi32((int)code);
+    int base = 0;
+    for (; base + 64 <= n; base += 64){
+        unsigned long long word = 0;
+        for (int j = 0; j < 64; j += 8){
+            __m256i equal = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(codes + base + j)), key);
+            word |= (unsigned long long)_mm256_movemask_ps(_mm256_castsi256_ps(equal)) << j;
+        }
+        bits[base / 64] = word;
+    }
+    matchCodesScalar(codes + base, n - base, code, bits + base / 64);
+}
+#endif
+
+static void (*codeMatcher)(const unsigned int codes[], int n, unsigned int code, unsigned long long bits[]);
+static const char *codeMatcherName;
+static pthread_once_t codeMatcherOnce = PTHREAD_ONCE_INIT;
+
+// Take the widest kernel the processor runs, FLIGHTS_SIMD=sse2 or FLIGHTS_SIMD=scalar asks for a narrower one
+void pickCodeMatcher(void){
+    const char *env = getenv("FLIGHTS_SIMD");
+    int widest = env == NULL ? 2 : (strcmp(env, "scalar") == 0 ? 0 : (strcmp(env, "sse2") == 0 ? 1 : 2));
+    codeMatcher = matchCodesScalar;
+    codeMatcherName = "scalar";
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (widest >= 2 && __builtin_cpu_supports("avx2")){
+        codeMatcher = matchCodesAVX2;
+        codeMatcherName = "avx2";
+    }else if (widest >= 1 && __builtin_cpu_supports("sse2")){
+        codeMatcher = matchCodesSSE2;
+        codeMatcherName = "sse2";
+    }
+#endif
+}
+
+// Set bit i of bits when codes[i] equals code, for the n codes of a column
+void matchCodes(const unsigned int codes[], int n, unsigned int code, unsigned long long bits[]){
+    pthread_once(&codeMatcherOnce, pickCodeMatcher);
+    codeMatcher(codes, n, code, bits);
+}
+
+// Name of the kernel matchCodes runs
+const char *codeKernel(void){
+    pthread_once(&codeMatcherOnce, pickCodeMatcher);
+    return codeMatcherName;
+}
+
+// Selection bitmap of a comparison over every slot, 64 slots per word, deleted slots are cleared by queryDB
+void scanComparison(flightDB *db, queryNode *n, unsigned long long bits[]){
+    unsigned char pass[64];
+    float values[64];
+    if ((n->attribute == 2 || n->attribute == 3) && (n->op == QUERY_EQ || n->op == QUERY_NE)){
+        matchCodes(n->attribute == 2 ? db->origin : db->destination, db->numSlots, n->code, bits);
+        for (int base = 0; base < db->numSlots && n->op == QUERY_NE; base += 64){
+            int count = db->numSlots - base < 64 ? db->numSlots - base : 64;
+            bits[base / 64] = ~bits[base / 64] & (count == 64 ? ~0ULL : (1ULL << count) - 1);
+        }
+        return;
+    }
+    for (int base = 0; base < db->numSlots; base += 64){
+        int count = db->numSlots - base < 64 ? db->numSlots - base : 64;
+        if (n->attribute <= 3){
+            for (int j = 0; j < count; j++)
+                pass[j] = matchComparison(db, n, base + j);
+        }else{
+            if (count == 64){
+                loadBlock(db, n->attribute, base, 64, values);
+            }else{
+                memset(values, 0, sizeof(values));
+                loadBlock(db, n->attribute, base, count, values);
+            }
+            compareBlock(n->op, values, n->value, pass);
+        }
+        unsigned long long word = packBits(pass);
+        bits[base / 64] = count == 64 ? word : word & ((1ULL << count) - 1);
+    }
+}
+
+// Number of rows an index lists for a comparison, -1 when no index serves it, the rows go to rows unless it is NULL
+// Exact flight numbers and airport codes use the hash and route indexes, numeric comparisons a range view once one is built
+int indexedRows(flightDB *db, queryNode *n, int rows[]){
+    int numRows = 0;
+    if (n->op == QUERY_EQ && n->attribute == 1){
+        flightIndex *index = &db->flightIdx;
+        if (index->numBuckets == 0)
+            return 0;
+        for (int row = index->heads[findFlight(db, n->text, hashFlight(n->text))]; row != EMPTY_BUCKET; row = index->nextRow[row]){
+            if (rows != NULL)
+                rows[numRows] = row;
+            numRows++;
+        }
+    }else if (n->op == QUERY_EQ && (n->attribute == 2 || n->attribute == 3)){
+        routeIndex *index = &db->routeIdx;
+        int id = lookupId(&index->codeIds, n->code, false);
+        if (id == EMPTY_BUCKET)
+            return 0;
+        postingList *list = n->attribute == 2 ? &index->byOrigin[id] : &index->byDestination[id];
+        numRows = list->numRows;
+        if (rows != NULL && numRows > 0)
+            memcpy(rows, list->rows, numRows * sizeof(int));
+    }else if (n->attribute >= FIRST_RANGE_ATTRIBUTE && n->op != QUERY_NE){
+        sortView *view = &db->views[SORT_VIEWS + n->attribute - FIRST_RANGE_ATTRIBUTE];
+        if (view->usedAt == 0)
+            return -1;
+        rangeTarget before = {n->attribute, n->value, false}, through = {n->attribute, n->value, true};
+        int from = 0, to = view->tree.root == NULL ? 0 : view->tree.root->count;
+        if (n->op == QUERY_EQ || n->op == QUERY_GE)
+            from = treeRank(db, &view->tree, valueBefore, &before);
+        if (n->op == QUERY_GT)
+            from = treeRank(db, &view->tree, valueBefore, &through);
+        if (n->op == QUERY_EQ || n->op == QUERY_LE)
+            to = treeRank(db, &view->tree, valueBefore, &through);
+        if (n->op == QUERY_LT)
+            to = treeRank(db, &view->tree, valueBefore, &before);
+        numRows = to > from ? to - from : 0;
+        if (rows != NULL && numRows > 0)
+            sliceTree(&view->tree, from, to, rows);
+    }else{
+        return -1;
+    }
+    return numRows;
+}
+
+// Nodes joined by a chain of AND
+void conjuncts(query *q, int node, int list[], int *numList){
+    if (q->nodes[node].op == QUERY_AND){
+        conjuncts(q, q->nodes[node].left, list, numList);
+        conjuncts(q, q->nodes[node].right, list, numList);
+    }else{
+        list[(*numList)++] = node;
+    }
+}
+
+// Selection bitmap of a node
+// Of an AND chain the comparison with the shortest index list is looked up and the other conjuncts are checked on its rows,
+// unless no index lists fewer than an eighth of the rows, then every conjunct is scanned and the bitmaps are ANDed
+void evalNode(flightDB *db, query *q, int node, unsigned long long bits[], int numWords){
+    unsigned long long *other = (unsigned long long *)malloc((numWords > 0 ? numWords : 1) * sizeof(unsigned long long));
+    if (q->nodes[node].op == QUERY_OR){
+        evalNode(db, q, q->nodes[node].left, bits, numWords);
+        evalNode(db, q, q->nodes[node].right, other, numWords);
+        for (int w = 0; w < numWords; w++)
+            bits[w] |= other[w];
+        free(other);
+        return;
+    }
+    int list[QUERY_NODES], numList = 0, best = -1, bestRows = 0;
+    conjuncts(q, node, list, &numList);
+    for (int i = 0; i < numList; i++){
+        int numRows = q->nodes[list[i]].op == QUERY_OR ? -1 : indexedRows(db, &q->nodes[list[i]], NULL);
+        if (numRows >= 0 && (best < 0 || numRows < bestRows)){
+            best = i;
+            bestRows = numRows;
+        }
+    }
+    if (best >= 0 && bestRows <= db->numRows / 8){
+        int *rows = (int *)malloc((bestRows > 0 ? bestRows : 1) * sizeof(int));
+        indexedRows(db, &q->nodes[list[best]], rows);
+        memset(bits, 0, numWords * sizeof(unsigned long long));
+        for (int r = 0; r < bestRows; r++){
+            bool match = true;
+            for (int i = 0; i < numList && match; i++)
+                match = i == best || matchRow(db, q, list[i], rows[r]);
+            if (match)
+                bits[rows[r] / 64] |= 1ULL << (rows[r] % 64);
+        }
+        free(rows);
+    }else{
+        for (int i = 0; i < numList; i++){
+            unsigned long long *target = i == 0 ? bits : other;
+            if (q->nodes[list[i]].op == QUERY_OR)
+                evalNode(db, q, list[i], target, numWords);
+            else
+                scanComparison(db, &q->nodes[list[i]], target);
+            for (int w = 0; w < numWords && i > 0; w++)
+                bits[w] &= other[w];
+        }
+    }
+    free(other);
+}
+
+// Run a parsed query, return number of matches found
+// Matches are in display order, or in the order of ORDER BY with ties in display order, and cut at LIMIT
+int queryDB(flightDB *db, query *q, searchResult *result){
+    result->numRows = 0;
+    ensureIndexes(db);
+    int numWords = (db->numSlots + 63) / 64;
+    unsigned long long *bits = (unsigned long long *)malloc((numWords > 0 ? numWords : 1) * sizeof(unsigned long long));
+    evalNode(db, q, q->root, bits, numWords);
+    // scans also pass deleted rows and rows held for a save
+    for (int i = 0; i < db->numFree; i++)
+        bits[db->freeRows[i] / 64] &= ~(1ULL << (db->freeRows[i] % 64));
+    for (int i = 0; i < db->numHeld; i++)
+        bits[db->heldRows[i] / 64] &= ~(1ULL << (db->heldRows[i] % 64));
+
+    int numMatches = 0;
+    for (int w = 0; w < numWords; w++)
+        numMatches += __builtin_popcountll(bits[w]);
+    if (numMatches > db->numRows / 64){
+        // many matches, walk the display order and keep the rows whose bit is set
+        reserveSearch(db, result, numMatches);
+        int slot;
+        for (orderNode *leaf = seekOrder(db, 0, &slot); leaf != NULL; leaf = leaf->next){
+            for (slot = 0; slot < leaf->numItems; slot++){
+                int row = leaf->rows[slot];
+                if (bits[row / 64] >> (row % 64) & 1)
+                    result->rows[result->numRows++] = row;
+            }
+        }
+    }else{
+        int *rows = (int *)malloc((numMatches > 0 ? numMatches : 1) * sizeof(int));
+        numMatches = 0;
+        for (int w = 0; w < numWords; w++){
+            for (unsigned long long word = bits[w]; word != 0; word &= word - 1)
+                rows[numMatches++] = w * 64 + __builtin_ctzll(word);
+        }
+        collectSearch(db, rows, numMatches, result);
+        free(rows);
+    }
+    free(bits);
+
+    if (q->nKeys > 0 && result->numRows > 1){
+        int *temp = (int *)malloc(result->numRows * sizeof(int));
+        sortRowList(db, result->rows, temp, result->numRows, q->keys, q->nKeys);
+        free(temp);
+    }
+    if (q->limit >= 0 && result->numRows > q->limit)
+        result->numRows = q->limit;
+    return result->numRows;
+}
+
+// Give the rows of a search result back, the result can be filled again afterwards
+void releaseSearch(flightDB *db, searchResult *result){
+    db->searchBytes -= (size_t)result->maxRows * sizeof(int);
+    free(result->rows);
+    result->rows = NULL;
+    result->numRows = 0;
+    result->maxRows = 0;
+}
+
+void writeFile(flightDB *db, FILE *fp){
+    rewind(fp);
+
+    fprintf(fp, DATASET_HEADER);
+
+    int slot;
+    for (orderNode *leaf = seekOrder(db, 0, &slot); leaf != NULL; leaf = leaf->next){
+        for (slot = 0; slot < leaf->numItems; slot++)
+            writeRecord(db, leaf->rows[slot], fp);
+    }
+    // Drop what is left of a longer previous version of the file
+    fflush(fp);
+    if (ftruncate(fileno(fp), ftell(fp)) != 0)
+        perror("Error Truncating File");
+    return;
+}
+
+// Snapshot layout: header, one record per row in display order, then the string table of flight numbers
+// Numbers are stored in the byte order of the machine, a snapshot that does not check out is ignored and the text is loaded
+typedef struct snapshotHeader{
+    char magic[8];              // SNAPSHOT_MAGIC
+    unsigned int version;       // SNAPSHOT_VERSION
+    unsigned int recordSize;    // sizeof(snapshotRecord), catches a build with another layout or byte order
+    long long numRows;
+    long long stringBytes;      // length of the string table
+    long long textSize;         // size of the dataset the snapshot was saved with
+    unsigned long long checksum;    // of the records and string table
+}snapshotHeader;
+
+typedef struct snapshotRecord{
+    unsigned int flightNumber;  // offset of the flight number in the string table
+    char origin[4];             // codes are not terminated when 4 letters long
+    char destination[4];
+    short capacity;
+    short departureHour;
+    short departureMinutes;
+    short stops;
+    float price;
+}snapshotRecord;
+
+// Checksum of the records and string table, a damaged snapshot must not be opened and saved back over the text
+unsigned long long snapshotChecksum(const char *p, size_t n){
+    unsigned long long sum = 0, word;
+    size_t i;
+    for (i = 0; i + sizeof(word) <= n; i += sizeof(word)){
+        memcpy(&word, p + i, sizeof(word));
+        sum = (sum ^ word) * 0x100000001b3ULL;
+    }
+    word = 0;
+    memcpy(&word, p + i, n - i);
+    return (sum ^ word) * 0x100000001b3ULL;
+}
+
+// Load a snapshot into an empty database, return false when it is missing, stale or damaged
+// textSize is the size of the dataset now, -1 skips the check
+// The indexes are left for the first search to build
+bool loadSnapshot(flightDB *db, const char *snapshot, long long textSize){
+    int fd = open(snapshot, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    snapshotHeader header;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(header) || read(fd, &header, sizeof(header)) != sizeof(header) ||
+        memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.version != SNAPSHOT_VERSION ||
+        header.recordSize != sizeof(snapshotRecord) || header.numRows < 0 || header.numRows > INT_MAX / 2 ||
+        header.stringBytes < 0 || (textSize >= 0 && header.textSize != textSize) ||
+        st.st_size != (off_t)(sizeof(header) + header.numRows * sizeof(snapshotRecord) + header.stringBytes)){
+        close(fd);
+        return false;
+    }
+    // every page is read, fault them in with one call
+    const char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    if (snapshotChecksum(data + sizeof(header), st.st_size - sizeof(header)) != header.checksum){
+        munmap((void *)data, st.st_size);
+        return false;
+    }
+
+    const snapshotRecord *records = (const snapshotRecord *)(data + sizeof(header));
+    const char *strings = (const char *)(records + header.numRows);
+    int numRows = (int)header.numRows;
+    reserveDB(db, numRows);
+    for (int row = 0; row < numRows; row++){
+        const snapshotRecord *r = &records[row];
+        // a flight number must end inside the table and fit its column
+        long long room = header.stringBytes - r->flightNumber;
+        if (room > (long long)sizeof(db->flightNumber[0]))
+            room = sizeof(db->flightNumber[0]);
+        if (room <= 0 || memchr(strings + r->flightNumber, '\0', room) == NULL){
+            munmap((void *)data, st.st_size);
+            freeDB(db);
+            return false;
+        }
+        strncpy(db->flightNumber[row], strings + r->flightNumber, sizeof(db->flightNumber[0]));
+        db->origin[row] = packCode(r->origin);
+        db->destination[row] = packCode(r->destination);
+        db->capacity[row] = r->capacity;
+        db->departureHour[row] = r->departureHour;
+        db->departureMinutes[row] = r->departureMinutes;
+        db->price[row] = r->price;
+        db->stops[row] = r->stops;
+    }
+    munmap((void *)data, st.st_size);
+
+    // rows were saved in display order
+    int *rows = (int *)malloc((numRows > 0 ? numRows : 1) * sizeof(int));
+    for (int row = 0; row < numRows; row++)
+        rows[row] = row;
+    db->numSlots = numRows;
+    db->numRows = numRows;
+    buildOrder(db, rows, numRows);
+    numberRows(db);
+    free(rows);
+    db->liveBytes = (size_t)numRows * ROW_BYTES;
+    if (db->liveBytes > db->peakBytes)
+        db->peakBytes = db->liveBytes;
+    db->indexPending = true;
+    return true;
+}
+
+// Write rows to a new snapshot file and fsync it, columns are read a chunk at a time under the column lock
+// textSize is the size of the dataset saved alongside, return false when the snapshot could not be written
+bool writeSnapshotRows(flightDB *db, int rows[], int numRows, const char *path, long long textSize){
+    FILE *out = fopen(path, "w+b");
+    if (!out)
+        return false;
+    setvbuf(out, NULL, _IOFBF, 1 << 16);
+
+    snapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.recordSize = sizeof(snapshotRecord);
+    header.numRows = numRows;
+    header.textSize = textSize;
+    fwrite(&header, sizeof(header), 1, out);
+
+    // records first, the string table follows in the same order so offsets are a running sum
+    snapshotRecord r;
+    memset(&r, 0, sizeof(r));
+    for (int i = 0; i < numRows; i += SAVE_CHUNK_ROWS){
+        int end = i + SAVE_CHUNK_ROWS < numRows ? i + SAVE_CHUNK_ROWS : numRows;
+        pthread_mutex_lock(&db->columnLock);
+        for (int j = i; j < end; j++){
+            int row = rows[j];
+            r.flightNumber = (unsigned int)header.stringBytes;
+            char code[5];
+            unpackCode(db->origin[row], code);
+            memcpy(r.origin, code, 4);
+            unpackCode(db->destination[row], code);
+            memcpy(r.destination, code, 4);
+            r.capacity = db->capacity[row];
+            r.departureHour = db->departureHour[row];
+            r.departureMinutes = db->departureMinutes[row];
+            r.price = db->price[row];
+            r.stops = db->stops[row];
+            fwrite(&r, sizeof(r), 1, out);
+            header.stringBytes += strlen(db->flightNumber[row]) + 1;
+        }
+        pthread_mutex_unlock(&db->columnLock);
+    }
+    for (int i = 0; i < numRows; i += SAVE_CHUNK_ROWS){
+        int end = i + SAVE_CHUNK_ROWS < numRows ? i + SAVE_CHUNK_ROWS : numRows;
+        pthread_mutex_lock(&db->columnLock);
+        for (int j = i; j < end; j++)
+            fwrite(db->flightNumber[rows[j]], strlen(db->flightNumber[rows[j]]) + 1, 1, out);
+        pthread_mutex_unlock(&db->columnLock);
+    }
+    if (fflush(out) != 0 || ferror(out)){
+        fclose(out);
+        unlink(path);
+        return false;
+    }
+
+    // the header goes in last, once the checksum of what follows it is known
+    size_t size = sizeof(header) + header.numRows * sizeof(snapshotRecord) + header.stringBytes;
+    const char *data = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(out), 0);
+    if (data != MAP_FAILED){
+        header.checksum = snapshotChecksum(data + sizeof(header), size - sizeof(header));
+        munmap((void *)data, size);
+    }
+    rewind(out);
+    fwrite(&header, sizeof(header), 1, out);
+    if (data == MAP_FAILED || fflush(out) != 0 || ferror(out) || fsync(fileno(out)) != 0){
+        fclose(out);
+        unlink(path);
+        return false;
+    }
+    fclose(out);
+    return true;
+}
+
+// Write the rows in display order to a snapshot, through a temporary file renamed over the old snapshot
+bool writeSnapshot(flightDB *db, const char *snapshot, long long textSize){
+    char temporary[PATH_MAX];
+    if (snprintf(temporary, sizeof(temporary), "%s.tmp", snapshot) >= (int)sizeof(temporary))
+        return false;
+    int *rows = (int *)malloc((db->numRows > 0 ? db->numRows : 1) * sizeof(int));
+    orderRows(db, rows);
+    bool written = writeSnapshotRows(db, rows, db->numRows, temporary, textSize);
+    free(rows);
+    if (written && rename(temporary, snapshot) != 0){
+        unlink(temporary);
+        return false;
+    }
+    return written;
+}
+
+// Open a dataset, from its snapshot when the snapshot was saved after the text last changed
+// Open the snapshot next to path when it is at least as new as the text, return false when the text has to be read
+bool openSnapshot(flightDB *db, FILE *fp, const char *path){
+    char snapshot[PATH_MAX];
+    struct stat text, snap;
+    if (snprintf(snapshot, sizeof(snapshot), "%s%s", path, SNAPSHOT_SUFFIX) < (int)sizeof(snapshot) &&
+        db->numSlots == 0 && fstat(fileno(fp), &text) == 0 && stat(snapshot, &snap) == 0 &&
+        (snap.st_mtim.tv_sec > text.st_mtim.tv_sec ||
+        (snap.st_mtim.tv_sec == text.st_mtim.tv_sec && snap.st_mtim.tv_nsec >= text.st_mtim.tv_nsec)) &&
+        loadSnapshot(db, snapshot, text.st_size)){
+        fprintf(stderr, "Opened %d rows from %s\n", db->numRows, snapshot);
+        return true;
+    }
+    return false;
+}
+
+void openDB(flightDB *db, FILE *fp, const char *path){
+    initCharClass();
+    if (!openSnapshot(db, fp, path))
+        loadFile(fp, db);
+}
+
+// Take the next chunk of the mapped file, parse it into its slot and hand it to pollLoad, until the end of the file
+// Workers take chunks in file order but may finish them out of order, pollLoad stores them in order.
+// No chunk is taken past the first bad line, pollLoad reports it once the rows before it are stored
+void *loadWorker(void *arg){
+    backgroundLoad *load = (backgroundLoad *)arg;
+    const char *fileEnd = load->data + load->size;
+    pthread_mutex_lock(&load->lock);
+    while (1){
+        while (!load->cancelled && !load->failed && load->nextChunk < fileEnd &&
+               load->numClaimed >= load->numTaken + LOAD_QUEUE_BATCHES)
+            pthread_cond_wait(&load->changed, &load->lock);
+        if (load->cancelled || load->failed || load->nextChunk >= fileEnd)
+            break;
+        const char *start = load->nextChunk, *end = chunkEnd(start, fileEnd);
+        int slot = load->numClaimed++ % LOAD_QUEUE_BATCHES;
+        load->nextChunk = end;
+        pthread_mutex_unlock(&load->lock);
+
+        parseLines(start, end, fileEnd, start == load->data, &load->slots[slot]);
+
+        pthread_mutex_lock(&load->lock);
+        load->ready[slot] = true;
+        if (load->slots[slot].status != PARSE_OK)
+            load->failed = true;
+        pthread_cond_broadcast(&load->changed);
+    }
+    load->numRunning--;
+    pthread_cond_broadcast(&load->changed);
+    pthread_mutex_unlock(&load->lock);
+    return NULL;
+}
+
+// Open a dataset like openDB, except that a text dataset is parsed by producer threads
+// The rows show up as pollLoad stores them, return true while they are still coming
+bool startLoad(flightDB *db, backgroundLoad *load, FILE *fp, const char *path){
+    memset(load, 0, sizeof(backgroundLoad));
+    initCharClass();
+    if (openSnapshot(db, fp, path))
+        return false;
+    load->data = mapFile(fp, &load->size);
+    if (load->data == NULL)
+        return false;
+    load->nextChunk = load->data;
+    pthread_mutex_init(&load->lock, NULL);
+    pthread_cond_init(&load->changed, NULL);
+    // the calling thread stores the rows, the other cores parse
+    int numWorkers = workerCount() > 1 ? workerCount() - 1 : 1;
+    for (load->numWorkers = 0; load->numWorkers < numWorkers; load->numWorkers++){
+        if (pthread_create(&load->threads[load->numWorkers], NULL, loadWorker, load) != 0)
+            break;
+    }
+    if (load->numWorkers == 0){
+        perror("Error Starting Load");
+        exit(EXIT_FAILURE);
+    }
+    load->numRunning = load->numWorkers;
+    load->running = true;
+    return true;
+}
+
+// Percentage of the file stored so far
+int loadProgress(backgroundLoad *load){
+    if (load->size == 0)
+        return 100;
+    return (int)(load->stored * 100 / load->size);
+}
+
+// Join the producers and drop what they left behind
+void endLoad(backgroundLoad *load){
+    for (int w = 0; w < load->numWorkers; w++)
+        pthread_join(load->threads[w], NULL);
+    for (int i = 0; i < LOAD_QUEUE_BATCHES; i++)
+        free(load->slots[i].records);
+    pthread_mutex_destroy(&load->lock);
+    pthread_cond_destroy(&load->changed);
+    munmap((void *)load->data, load->size);
+    free(load->rows);
+    load->rows = NULL;
+    load->running = false;
+}
+
+// Store the chunks parsed so far at the end of the display order, waiting for them up to LOAD_POLL_MS
+// or until the end of the file when wait is set. A bad line is reported like loadFile does.
+// Return LOAD_RUNNING, LOAD_DONE once the last row is stored, LOAD_IDLE when no load is running
+int pollLoad(flightDB *db, backgroundLoad *load, bool wait){
+    struct timespec deadline;
+    if (!load->running)
+        return LOAD_IDLE;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += LOAD_POLL_MS * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L){
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    while (1){
+        int slot = load->numTaken % LOAD_QUEUE_BATCHES, timedOut = 0;
+        pthread_mutex_lock(&load->lock);
+        while (!load->ready[slot] && (load->numRunning > 0 || load->numTaken < load->numClaimed) && timedOut == 0){
+            if (wait)
+                pthread_cond_wait(&load->changed, &load->lock);
+            else
+                timedOut = pthread_cond_timedwait(&load->changed, &load->lock, &deadline);
+        }
+        bool ready = load->ready[slot];
+        pthread_mutex_unlock(&load->lock);
+
+        if (!ready){
+            if (timedOut != 0)
+                return LOAD_RUNNING;
+            break;
+        }
+        // the chunk is indexed as a whole, each index stays hot in the cache like loadFile does
+        loadBatch *batch = &load->slots[slot];
+        if (batch->numRecords > load->maxRows){
+            load->maxRows = batch->numRecords;
+            load->rows = (int *)realloc(load->rows, load->maxRows * sizeof(int));
+        }
+        for (int i = 0; i < batch->numRecords; i++){
+            load->rows[i] = storeRow(db, &batch->records[i]);
+            insertOrder(db, db->numRows++, load->rows[i]);
+        }
+        indexRows(db, load->rows, batch->numRecords);
+        if (batch->status != PARSE_OK)
+            loadError(batch->status, load->lines + batch->numLines);
+        load->lines += batch->numLines;
+        load->stored += batch->bytes;
+
+        // the slot is free for the chunk LOAD_QUEUE_BATCHES further on
+        pthread_mutex_lock(&load->lock);
+        load->ready[slot] = false;
+        load->numTaken++;
+        pthread_cond_broadcast(&load->changed);
+        pthread_mutex_unlock(&load->lock);
+
+        if (!wait){
+            struct timespec t;
+            clock_gettime(CLOCK_REALTIME, &t);
+            if (t.tv_sec > deadline.tv_sec || (t.tv_sec == deadline.tv_sec && t.tv_nsec >= deadline.tv_nsec))
+                return LOAD_RUNNING;
+        }
+    }
+
+    endLoad(load);
+    // rows were appended one at a time, rebuild the order tree with full leaves
+    int *rows = (int *)malloc((db->numRows > 0 ? db->numRows : 1) * sizeof(int));
+    orderRows(db, rows);
+    buildOrder(db, rows, db->numRows);
+    numberRows(db);
+    free(rows);
+    return LOAD_DONE;
+}
+
+// Stop a load that is still running, the rows stored so far stay in db
+void stopLoad(backgroundLoad *load){
+    if (!load->running)
+        return;
+    pthread_mutex_lock(&load->lock);
+    load->cancelled = true;
+    pthread_cond_broadcast(&load->changed);
+    pthread_mutex_unlock(&load->lock);
+    endLoad(load);
+}
+
+// Write rows to a new dataset file and fsync it, columns are read a chunk at a time under the column lock
+// written counts the rows done so far
+bool writeRows(flightDB *db, int rows[], int numRows, const char *path, atomic_int *written){
+    FILE *out = fopen(path, "w");
+    if (!out)
+        return false;
+    setvbuf(out, NULL, _IOFBF, 1 << 16);
+    fputs(DATASET_HEADER, out);
+    for (int i = 0; i < numRows; i += SAVE_CHUNK_ROWS){
+        int end = i + SAVE_CHUNK_ROWS < numRows ? i + SAVE_CHUNK_ROWS : numRows;
+        pthread_mutex_lock(&db->columnLock);
+        for (int j = i; j < end; j++)
+            writeRecord(db, rows[j], out);
+        pthread_mutex_unlock(&db->columnLock);
+        atomic_store(written, end);
+    }
+    if (fflush(out) != 0 || ferror(out) || fsync(fileno(out)) != 0){
+        fclose(out);
+        unlink(path);
+        return false;
+    }
+    fclose(out);
+    return true;
+}
+
+// Worker of a background save, writes the dataset and then its snapshot to temporary files
+void *saveWorker(void *arg){
+    journal *log = (journal *)arg;
+    backgroundSave *save = &log->save;
+    struct stat st;
+    save->failed = !writeRows(save->db, save->rows, save->numRows, save->text, &save->written) ||
+                   stat(save->text, &st) != 0;
+    // the snapshot is written after the text so that it is the newer file
+    if (!save->failed && !writeSnapshotRows(save->db, save->rows, save->numRows, save->snapshot, st.st_size))
+        unlink(save->snapshot);
+    atomic_store(&save->finished, true);
+    return NULL;
+}
+
+// Save the dataset on a worker thread, the rows are written as they are now while editing goes on
+// Until pollSave puts the files in place updates go to new rows and deleted rows are not reused, see updateDB and deleteDB
+// Return false when a save is already running or could not be started
+bool startSave(flightDB *db, journal *log){
+    backgroundSave *save = &log->save;
+    if (save->running)
+        return false;
+    if (snprintf(save->text, sizeof(save->text), "%s.save", log->path) >= (int)sizeof(save->text) ||
+        snprintf(save->snapshot, sizeof(save->snapshot), "%s%s.save", log->path, SNAPSHOT_SUFFIX) >= (int)sizeof(save->snapshot))
+        return false;
+    syncJournal(log);
+    save->db = db;
+    save->rows = (int *)malloc((db->numRows > 0 ? db->numRows : 1) * sizeof(int));
+    save->numRows = db->numRows;
+    orderRows(db, save->rows);
+    atomic_store(&save->written, 0);
+    atomic_store(&save->finished, false);
+    save->failed = false;
+    // the saved file is in display order, so ties sort the way they would after reopening it
+    logRenumber(db);
+    numberRows(db);
+    save->journalStart = log->bytes;
+    save->sortsBefore = log->numSorts;
+    db->copyOnWrite = true;
+    if (pthread_create(&save->thread, NULL, saveWorker, log) != 0){
+        db->copyOnWrite = false;
+        free(save->rows);
+        save->rows = NULL;
+        return false;
+    }
+    save->running = true;
+    return true;
+}
+
+// Percentage of the rows a background save has written
+int saveProgress(journal *log){
+    backgroundSave *save = &log->save;
+    if (!save->running || save->numRows == 0)
+        return 100;
+    return (int)(atomic_load(&save->written) * 100LL / save->numRows);
+}
+
+// Give a file that replaces or sits next to the dataset at from its permissions and, where allowed, its owner
+// Return false when the owner or the group could not be kept
+bool copyMode(const char *from, const char *to){
+    struct stat st;
+    if (stat(from, &st) != 0)
+        return false;
+    // only root can give a file away, the group can still be kept when the user is in it
+    bool owned = chown(to, st.st_uid, st.st_gid) == 0 || chown(to, -1, st.st_gid) == 0;
+    return chmod(to, st.st_mode & 07777) == 0 && owned;
+}
+
+// Put a finished save in place of the dataset, the journal goes on with only the edits made during the save
+// The new journal is written before the dataset is renamed, replayJournal picks it up if the last rename did not happen
+bool installSave(journal *log){
+    backgroundSave *save = &log->save;
+    char name[PATH_MAX], next[PATH_MAX], snapshot[PATH_MAX], buffer[1 << 16];
+    struct stat st;
+    FILE *out = NULL;
+    copyMode(log->path, save->text);
+    copyMode(log->path, save->snapshot);
+    if (stat(save->text, &st) != 0 ||
+        snprintf(name, sizeof(name), "%s%s", log->path, JOURNAL_SUFFIX) >= (int)sizeof(name) ||
+        snprintf(next, sizeof(next), "%s.next", name) >= (int)sizeof(next) ||
+        snprintf(snapshot, sizeof(snapshot), "%s%s", log->path, SNAPSHOT_SUFFIX) >= (int)sizeof(snapshot))
+        return false;
+
+    if (log->fp != NULL){
+        out = fopen(next, "w+");
+        if (out == NULL)
+            return false;
+        copyMode(log->path, next);
+        fprintf(out, "%s %lld %lld %lld\n", JOURNAL_HEADER, (long long)st.st_size, (long long)st.st_mtim.tv_sec,
+        (long long)st.st_mtim.tv_nsec);
+        fflush(log->fp);
+        for (long long offset = save->journalStart; offset < log->bytes;){
+            ssize_t n = pread(fileno(log->fp), buffer, sizeof(buffer), offset);
+            if (n <= 0)
+                break;
+            fwrite(buffer, 1, n, out);
+            offset += n;
+        }
+        if (fflush(out) != 0 || ferror(out) || fsync(fileno(out)) != 0){
+            fclose(out);
+            unlink(next);
+            return false;
+        }
+    }
+    if (rename(save->text, log->path) != 0){
+        if (out != NULL){
+            fclose(out);
+            unlink(next);
+        }
+        return false;
+    }
+    // the new dataset is in place, an old snapshot is older than it and is not opened any more
+    if (rename(save->snapshot, snapshot) != 0)
+        unlink(save->snapshot);
+    // so are the edits of a journal replayed read only
+    if (out == NULL && log->readOnly){
+        unlink(next);
+        unlink(name);
+        log->readOnly = false;
+    }
+    FILE *base = fopen(log->path, "r+");
+    if (base != NULL){
+        fclose(log->base);
+        log->base = base;
+    }
+    log->baseSize = st.st_size;
+    log->baseSeconds = st.st_mtim.tv_sec;
+    log->baseNanoseconds = st.st_mtim.tv_nsec;
+    if (out != NULL){
+        rename(next, name);
+        fclose(log->fp);
+        log->fp = out;
+        fseek(log->fp, 0, SEEK_END);
+        log->bytes = ftell(log->fp);
+        log->numSorts -= save->sortsBefore;
+    }
+    return true;
+}
+
+// Check on a background save, once the worker is done its files are put in place
+// wait blocks until then, SAVE_DONE and SAVE_FAILED are returned once, SAVE_IDLE afterwards
+int pollSave(flightDB *db, journal *log, bool wait){
+    backgroundSave *save = &log->save;
+    if (!save->running)
+        return SAVE_IDLE;
+    if (!wait && !atomic_load(&save->finished))
+        return SAVE_RUNNING;
+    pthread_join(save->thread, NULL);
+    save->running = false;
+    free(save->rows);
+    save->rows = NULL;
+    bool installed = !save->failed && installSave(log);
+    if (!installed){
+        unlink(save->text);
+        unlink(save->snapshot);
+    }
+    releaseRows(db);
+    return installed ? SAVE_DONE : SAVE_FAILED;
+}
+
+// Start an empty journal for the dataset as it is now on disk
+void resetJournal(journal *log){
+    struct stat st;
+    if (log->fp == NULL || fstat(fileno(log->base), &st) != 0)
+        return;
+    log->baseSize = st.st_size;
+    log->baseSeconds = st.st_mtim.tv_sec;
+    log->baseNanoseconds = st.st_mtim.tv_nsec;
+    rewind(log->fp);
+    fprintf(log->fp, "%s %lld %lld %lld\n", JOURNAL_HEADER, log->baseSize, log->baseSeconds, log->baseNanoseconds);
+    fflush(log->fp);
+    log->bytes = ftell(log->fp);
+    if (ftruncate(fileno(log->fp), log->bytes) != 0)
+        snprintf(log->notice, sizeof(log->notice), "Error Truncating Journal: %s", strerror(errno));
+    fdatasync(fileno(log->fp));
+    log->numSorts = 0;
+    log->pending = 0;
+    log->syncedAt = time(NULL);
+}
+
+// Read the header of a journal, return true when it was written for the dataset as it is now
+bool journalFor(FILE *fp, struct stat *base){
+    char line[128];
+    long long size, seconds, nanoseconds;
+    return fgets(line, sizeof(line), fp) != NULL &&
+           sscanf(line, JOURNAL_HEADER " %lld %lld %lld", &size, &seconds, &nanoseconds) == 3 &&
+           size == base->st_size && seconds == base->st_mtim.tv_sec && nanoseconds == base->st_mtim.tv_nsec;
+}
+
+// Apply one journal record, return false when it is damaged or does not fit the rows
+bool replayRecord(flightDB *db, const char *line, const char *end, sortKey keys[]){
+    dataSet record;
+    char *p;
+    long position = 0;
+    char op = line[0];
+    // a renumbering is the only record without arguments
+    if (op == 'R' && line + 1 == end){
+        numberRows(db);
+        return true;
+    }
+    if (line + 1 >= end || line[1] != ' ')
+        return false;
+    line += 2;
+    if (op == 'I' || op == 'D' || op == 'U'){
+        position = strtol(line, &p, 10);
+        if (p == line || position < 0 || position > (op == 'I' ? db->numRows : db->numRows - 1))
+            return false;
+        line = p;
+        if (op != 'D' && *line++ != ' ')
+            return false;
+    }
+    switch (op)
+    {
+    case 'A':
+    case 'I':
+    case 'U':
+        if (parseRecord(line, end, &record) != PARSE_OK)
+            return false;
+        if (op == 'A')
+            appendDB(db, &record);
+        else if (op == 'I')
+            insertDB(db, (int)position, &record);
+        else
+            updateDB(db, (int)position, &record);
+        return true;
+    case 'D':
+        if (line != end)
+            return false;
+        deleteDB(db, (int)position);
+        return true;
+    case 'S':{
+        int nKeys = 0;
+        while (line < end && nKeys < 7){
+            long attribute = strtol(line, &p, 10);
+            if (p == line || attribute < 1 || attribute > 7)
+                return false;
+            keys[nKeys].attribute = (int)attribute;
+            keys[nKeys].descending = *p == '-';
+            line = p + keys[nKeys++].descending;
+        }
+        if (nKeys == 0 || line != end)
+            return false;
+        sortDBKeys(db, keys, nKeys);
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// Free name to move a journal aside to, the journal name with .stale and then .stale.1, .stale.2...
+bool staleName(const char *name, char stale[PATH_MAX]){
+    for (int i = 0; i < 100; i++){
+        int length = i == 0 ? snprintf(stale, PATH_MAX, "%s.stale", name) : snprintf(stale, PATH_MAX, "%s.stale.%d", name, i);
+        if (length >= PATH_MAX)
+            return false;
+        if (access(stale, F_OK) != 0)
+            return true;
+    }
+    return false;
+}
+
+// Replay the journal of an opened dataset over it and keep the journal open for appending, return the records replayed
+// A journal written for another version of the dataset is moved aside to .stale and a new one started, since its edits
+// may not be anywhere else. Replay stops at a damaged or torn record
+// and the journal is cut there. What happened is left in log->notice. Edits are only journaled once db->log points at log.
+// readOnly replays an existing journal without creating, moving or cutting it and leaves log->fp NULL
+int replayJournal(flightDB *db, journal *log, FILE *base, const char *path, bool readOnly){
+    char name[PATH_MAX], next[PATH_MAX], line[512];
+    sortKey keys[7];
+    int replayed = 0;
+    struct stat st, own;
+    memset(log, 0, sizeof(journal));
+    log->base = base;
+    log->syncedAt = time(NULL);
+    snprintf(log->path, sizeof(log->path), "%s", path);
+    if (snprintf(name, sizeof(name), "%s%s", path, JOURNAL_SUFFIX) >= (int)sizeof(name) ||
+        snprintf(next, sizeof(next), "%s.next", name) >= (int)sizeof(next) || fstat(fileno(base), &st) != 0)
+        return 0;
+
+    // a save stopped between renaming the dataset and renaming its journal left the journal of the new dataset
+    FILE *pending = fopen(next, "r");
+    if (pending != NULL){
+        bool current = journalFor(pending, &st);
+        fclose(pending);
+        if (readOnly){
+            if (current)
+                memcpy(name, next, sizeof(name));
+        }else if (!current || rename(next, name) != 0){
+            unlink(next);
+        }
+    }
+
+    int fd = open(name, readOnly ? O_RDONLY : O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || (log->fp = fdopen(fd, readOnly ? "r" : "r+")) == NULL){
+        if (!readOnly || errno != ENOENT)
+            snprintf(log->notice, sizeof(log->notice), "Error Opening Journal: %s", strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return 0;
+    }
+
+    if (!readOnly && fstat(fd, &own) == 0 && own.st_size == 0)
+        copyMode(path, name);
+    if (fstat(fd, &own) != 0){
+        snprintf(log->notice, sizeof(log->notice), "Error Opening Journal: %s", strerror(errno));
+        fclose(log->fp);
+        log->fp = NULL;
+        return 0;
+    }
+    if (!journalFor(log->fp, &st)){
+        bool edits = own.st_size > 0 && fgets(line, sizeof(line), log->fp) != NULL;
+        if (readOnly){
+            if (edits)
+                snprintf(log->notice, sizeof(log->notice), "Journal %s of another version of the dataset is not replayed", name);
+            fclose(log->fp);
+            log->fp = NULL;
+            return 0;
+        }
+        // a journal with nothing after its header holds no edits and is simply started over
+        if (edits){
+            char stale[PATH_MAX];
+            fclose(log->fp);
+            log->fp = NULL;
+            if (!staleName(name, stale) || rename(name, stale) != 0){
+                snprintf(log->notice, sizeof(log->notice), "Journal of another version of the dataset cannot be moved aside, edits are not journaled");
+                return 0;
+            }
+            snprintf(log->notice, sizeof(log->notice), "Journal of another version of the dataset moved to %s", stale);
+            fd = open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+            if (fd < 0 || (log->fp = fdopen(fd, "r+")) == NULL){
+                snprintf(log->notice, sizeof(log->notice), "Error Opening Journal: %s", strerror(errno));
+                if (fd >= 0)
+                    close(fd);
+                return 0;
+            }
+            copyMode(path, name);
+        }
+        resetJournal(log);
+        return 0;
+    }
+    log->baseSize = st.st_size;
+    log->baseSeconds = st.st_mtim.tv_sec;
+    log->baseNanoseconds = st.st_mtim.tv_nsec;
+
+    long good = ftell(log->fp);
+    while (fgets(line, sizeof(line), log->fp) != NULL){
+        char *end = strchr(line, '\n');
+        if (end == NULL || !replayRecord(db, line, end, keys)){
+            snprintf(log->notice, sizeof(log->notice), "Journal %s is damaged after %d edits, the rest is %s", name, replayed,
+                     readOnly ? "skipped" : "dropped");
+            break;
+        }
+        if (line[0] == 'S')
+            log->numSorts++;
+        replayed++;
+        good = ftell(log->fp);
+    }
+    if (readOnly){
+        // a save puts the replayed edits in the dataset and removes the journal, see installSave
+        fclose(log->fp);
+        log->fp = NULL;
+        log->readOnly = true;
+    }else{
+        // append after the last good record
+        fseek(log->fp, good, SEEK_SET);
+        if (ftruncate(fileno(log->fp), good) != 0)
+            snprintf(log->notice, sizeof(log->notice), "Error Truncating Journal: %s", strerror(errno));
+        log->bytes = good;
+    }
+    if (replayed > 0 && log->notice[0] == '\0')
+        snprintf(log->notice, sizeof(log->notice), "Replayed %d edits from %s", replayed, name);
+    return replayed;
+}
+
+// Save the dataset with every journaled edit in it and start the journal over, waiting for the save
+// Return SAVE_DONE or SAVE_FAILED
+int compactJournal(flightDB *db, journal *log){
+    pollSave(db, log, true);
+    if (!startSave(db, log))
+        return SAVE_FAILED;
+    return pollSave(db, log, true);
+}
+
+// Make the journal durable and start compacting it in the background once replaying it would cost more than saving
+// Return true when a background save was started
+bool commitJournal(flightDB *db, journal *log){
+    syncJournal(log);
+    if (log->bytes > JOURNAL_COMPACT_BYTES + log->baseSize / 4 || log->numSorts > JOURNAL_COMPACT_SORTS)
+        return startSave(db, log);
+    return false;
+}
+
+// Finish a running save, then close the journal and the dataset
+void closeJournal(flightDB *db, journal *log){
+    pollSave(db, log, true);
+    if (log->fp != NULL){
+        syncJournal(log);
+        fclose(log->fp);
+    }
+    log->fp = NULL;
+    if (log->base != NULL)
+        fclose(log->base);
+    log->base = NULL;
+}
@@ -0,0 +1,406 @@
+#ifndef FLIGHTS_H
+#define FLIGHTS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define FILENAME "dataset"
+// Line grammar of the dataset, parseRecord implements it by hand with field lengths narrowed to avoid overflow
+#define REGEX_EXPRESSION "^.{2,3}\\s[0-9]*,[A-Z]+,[A-Z]+,[0-9]+,[0-9]{4},(0|[1-9][0-9]*)(\\.[0-9]+)?,[0-9]{1},\n*.*$"
+
+// Return codes of parseRecord
+#define PARSE_OK 0
+#define PARSE_FORMAT_ERROR 1
+#define PARSE_TIME_ERROR 2
+#define PARSE_BLANK_LINE 3
+
+#define DATASET_HEADER "Flight number,origin,destination,capacity,departure time,price,stops,\n"
+
+// Edits are appended to a journal next to the dataset and replayed over it when it is opened
+#define JOURNAL_SUFFIX ".journal"
+#define JOURNAL_HEADER "FLIGHTS JOURNAL 1"
+#define JOURNAL_SYNC_RECORDS 64         // fsync at least every this many records
+#define JOURNAL_SYNC_SECONDS 1          // or when the last fsync is this old
+#define JOURNAL_COMPACT_BYTES (1 << 20) // journals past this plus a quarter of the dataset are saved into it
+#define JOURNAL_COMPACT_SORTS 8         // every sort is replayed in full, a few are enough to compact
+
+// Binary snapshot saved next to the dataset, opened instead of the text while it is newer
+#define SNAPSHOT_SUFFIX ".snap"
+#define SNAPSHOT_MAGIC "FLTSNAP"
+#define SNAPSHOT_VERSION 1
+
+typedef struct dataSet{
+    char flightNumber[20];
+    char origin[5];
+    char destination[5];
+    short capacity;
+    short departureHour;
+    short departureMinutes;
+    float price;
+    short stops;
+}dataSet;
+
+// Fixed size node allocator, nodes are carved out of slabs and recycled through a free list
+typedef struct slabPool{
+    size_t nodeSize;
+    int nodesPerSlab;
+    void **slabs;
+    int numSlabs;
+    void *freeList;
+    size_t liveBytes;   // bytes of nodes handed out and not freed yet
+    size_t peakBytes;
+}slabPool;
+
+// Open addressing hash table from each distinct flight number to the rows that share it
+// Linear probing with backward shift deletion, so there are no tombstones
+// Rows of the same flight number are chained through nextRow/prevRow so duplicates never lengthen a probe
+typedef struct flightIndex{
+    int *heads;             // first row of the flight number in this bucket, EMPTY_BUCKET when unused
+    unsigned int *hashes;   // hash of the flight number in the same bucket
+    int numBuckets;         // always a power of two
+    int numKeys;
+    int *nextRow;           // indexed by row, EMPTY_BUCKET ends the chain
+    int *prevRow;
+    int maxRows;
+}flightIndex;
+
+#define EMPTY_BUCKET -1
+
+// Open addressing map from a 64 bit key to a small dense id, used to number airport codes and routes
+typedef struct idMap{
+    unsigned long long *keys;
+    int *ids;               // EMPTY_BUCKET when unused
+    int numBuckets;         // always a power of two
+    int numIds;
+}idMap;
+
+// Unordered list of rows, rows remember their slot so removal is a swap with the last slot
+typedef struct postingList{
+    int *rows;
+    int numRows;
+    int maxRows;
+}postingList;
+
+// Inverted index from airport codes and origin->destination pairs to rows
+// Codes are few compared to rows, so a query only touches the rows that match
+typedef struct routeIndex{
+    idMap codeIds;          // packed code -> code id
+    idMap routeIds;         // (origin id, destination id) -> route id
+    char (*codes)[5];       // code text by code id
+    int maxCodes;
+    postingList *byOrigin;          // by code id
+    postingList *byDestination;     // by code id
+    postingList *byRoute;           // by route id
+    int maxRoutes;
+    int *originSlot;        // indexed by row, slot of the row in its posting lists
+    int *destinationSlot;
+    int *routeSlot;
+    int *routeOf;           // indexed by row, route id of the row
+    int maxRows;
+}routeIndex;
+
+// Inverted index from every trigram of a flight number to the rows containing it
+// Posting lists are kept sorted by row so candidate lists can be intersected
+typedef struct gramIndex{
+    idMap gramIds;          // packed trigram -> gram id
+    postingList *byGram;    // by gram id
+    int maxGrams;
+}gramIndex;
+
+// Counted B+-tree holding the display order, every node knows how many rows lie below it
+// so the row at a position, the position of a row and inserting or removing at a position are all O(log n)
+#define ORDER_LEAF_ROWS 128
+#define ORDER_FANOUT 64
+typedef struct orderNode{
+    struct orderNode *parent;
+    struct orderNode *next;     // leaves only, neighbouring leaves in display order
+    struct orderNode *prev;
+    int count;                  // rows below this node
+    int numItems;               // rows of a leaf, children of an inner node
+    bool leaf;
+    union{
+        int rows[ORDER_LEAF_ROWS];
+        struct orderNode *children[ORDER_FANOUT];
+    };
+}orderNode;
+
+typedef struct orderTree{
+    orderNode *root;
+    slabPool pool;      // nodes of the tree
+}orderTree;
+
+// One level of ordering used by sortDBKeys, attribute uses the same 1-7 numbering as sortDB
+typedef struct sortKey{
+    int attribute;
+    bool descending;
+}sortKey;
+
+// The rows sorted on one key, kept in order through every edit so that sorting on the key again is a copy
+// Rows with equal keys follow their sequence number, so a view does not depend on the order it was sorted from
+#define SORT_VIEWS 4    // views kept at once, the least recently used one is dropped
+// Range searches keep one more ascending view per numeric attribute, built by the first search on it
+#define FIRST_RANGE_ATTRIBUTE 4     // capacity, then departure time, price and stops
+#define RANGE_VIEWS 4
+typedef struct sortView{
+    sortKey key;
+    orderTree tree;
+    unsigned long usedAt;   // 0 while the view is not built
+}sortView;
+
+// Save of the dataset on a worker thread, it writes the rows as they were when it started while editing goes on
+// The files are written next to the dataset and renamed into place by pollSave
+#define SAVE_CHUNK_ROWS 4096    // rows written between taking and dropping the column lock
+#define SAVE_IDLE 0
+#define SAVE_RUNNING 1
+#define SAVE_DONE 2
+#define SAVE_FAILED 3
+typedef struct backgroundSave{
+    pthread_t thread;
+    bool running;           // started and not yet put in place
+    atomic_bool finished;   // set by the worker
+    bool failed;
+    struct flightDB *db;
+    int *rows;              // display order when the save started
+    int numRows;
+    atomic_int written;     // rows written so far
+    long long journalStart; // journal records from here on were made during the save
+    int sortsBefore;
+    char text[PATH_MAX];        // temporary dataset
+    char snapshot[PATH_MAX];    // temporary snapshot
+}backgroundSave;
+
+// Journal of the edits made since the dataset was last saved
+// The header names the size and modification time of the dataset it applies to, a journal of another version is dropped
+typedef struct journal{
+    FILE *fp;               // NULL when the journal cannot be written
+    FILE *base;             // the dataset
+    char path[PATH_MAX];    // of the dataset
+    long long baseSize;
+    long long baseSeconds;
+    long long baseNanoseconds;
+    long long bytes;        // records written since the dataset was saved
+    int numSorts;
+    int pending;            // records written since the last fsync
+    bool readOnly;          // replayed without keeping it open, its edits are only in the rows until a save
+    time_t syncedAt;
+    backgroundSave save;    // compaction in progress
+    char notice[PATH_MAX + 128];    // what replaying found, for the caller to show
+}journal;
+
+// Parallel work, FLIGHTS_THREADS overrides the number of worker threads
+#define MAX_WORKERS 64
+#define PARALLEL_INDEX_ROWS 16384   // bulk indexing below this many rows stays on one thread
+#define PARALLEL_SORT_ROWS 65536    // sorts below this many rows stay on one thread
+#define RADIX_BITS 11               // bits of a radix sort digit, 1440 departure minutes fit in one
+
+// Records parsed from a newline aligned chunk of a dataset file
+#define LOAD_CHUNK_BYTES (1 << 20)
+typedef struct loadBatch{
+    dataSet *records;
+    int numRecords;
+    int maxRecords;
+    int numLines;           // lines of the chunk before the bad one, or all of them
+    int status;             // PARSE_OK or why the line after numLines was rejected
+    size_t bytes;           // length of the chunk
+}loadBatch;
+
+// Load of a text dataset by producer threads, they parse chunks and pollLoad stores them on the calling thread
+// so the screen can show the first rows while the rest of the file is read
+#define LOAD_QUEUE_BATCHES 8    // chunks parsed ahead of pollLoad, the producers wait beyond this
+#define LOAD_POLL_MS 20         // longest a poll that does not wait for the end spends storing rows
+#define LOAD_IDLE 0
+#define LOAD_RUNNING 1
+#define LOAD_DONE 2
+typedef struct backgroundLoad{
+    pthread_t threads[MAX_WORKERS];
+    int numWorkers;
+    bool running;           // started and not yet finished by pollLoad
+    pthread_mutex_t lock;   // guards everything down to cancelled
+    pthread_cond_t changed; // a chunk was parsed or stored, or a producer stopped
+    loadBatch slots[LOAD_QUEUE_BATCHES];    // chunk n of the file is parsed into slot n % LOAD_QUEUE_BATCHES
+    bool ready[LOAD_QUEUE_BATCHES];         // the slot holds a parsed chunk pollLoad has not stored yet
+    const char *nextChunk;  // start of the first chunk no producer took
+    int numClaimed;         // chunks taken by the producers
+    int numTaken;           // chunks stored by pollLoad
+    int numRunning;         // producers still running
+    bool failed;            // a chunk holds a bad line, no chunk after it is taken
+    bool cancelled;         // set by stopLoad
+    const char *data;       // the mapped file
+    size_t size;
+    size_t stored;          // bytes of the file stored so far
+    int lines;              // lines stored so far, header included
+    int *rows;              // rows of the chunk being stored
+    int maxRows;
+}backgroundLoad;
+
+// Columnar storage of the dataset, each attribute is a contiguous array indexed by row
+// The order tree holds the rows in display order, so positions and rows are not the same thing
+typedef struct flightDB{
+    char (*flightNumber)[20];
+    unsigned int *origin;       // airport codes packed by packCode
+    unsigned int *destination;
+    short *capacity;
+    short *departureHour;
+    short *departureMinutes;
+    float *price;
+    short *stops;
+    orderTree order;        // display order
+    int numRows;    // rows listed in order
+    int numSlots;   // rows handed out so far, deleted rows included
+    int maxSlots;   // allocated length of every array
+    int *freeRows;  // deleted rows waiting to be reused by newRow
+    int numFree;
+    size_t liveBytes;   // bytes of the rows listed in order
+    size_t peakBytes;
+    size_t searchBytes;     // bytes held by search results
+    size_t peakSearchBytes;
+    flightIndex flightIdx;  // exact flight number lookup
+    routeIndex routeIdx;    // rows by origin, destination and route
+    gramIndex gramIdx;      // flight number substrings
+    orderNode **leafOf;     // indexed by row, leaf of the order tree holding the row
+    unsigned long version;  // bumped by every change to the rows or their order, tells the screen what it drew is stale
+    bool indexPending;      // rows came from a snapshot and are not indexed yet, the first search indexes them
+    journal *log;           // every edit and sort is appended here when not NULL
+    bool copyOnWrite;       // a background save reads the rows, updates go to new rows and deleted rows are held back
+    int *heldRows;          // deleted while copyOnWrite, reused once the save is over
+    int numHeld;
+    int maxHeld;
+    pthread_mutex_t columnLock;     // held while the columns are reallocated or read by a background save
+    int *sequence;          // indexed by row, breaks ties between equal keys of a sort
+    int nextSequence;       // of the next row stored
+    sortView views[SORT_VIEWS + RANGE_VIEWS];   // sorted views, then the range views
+    unsigned long viewClock;
+}flightDB;
+
+// Rows matched by a search function, in display order except for range searches which list them in order of the attribute
+typedef struct searchResult{
+    int *rows;
+    int numRows;
+    int maxRows;
+}searchResult;
+
+// Query such as "origin=KUL AND stops=0 AND price<300 ORDER BY departure LIMIT 50", parsed into a tree of nodes
+#define QUERY_NODES 32
+#define QUERY_EQ 1
+#define QUERY_NE 2
+#define QUERY_LT 3
+#define QUERY_LE 4
+#define QUERY_GT 5
+#define QUERY_GE 6
+#define QUERY_CONTAINS 7    // ~, substring of a flight number or airport code
+#define QUERY_AND 8
+#define QUERY_OR 9
+typedef struct queryNode{
+    int op;
+    int attribute;      // 1-7 of a comparison
+    int left, right;    // nodes joined by AND and OR
+    char text[20];      // compared with flight number, origin and destination
+    unsigned int code;  // text packed, compared with origin and destination
+    float value;        // compared with the numeric attributes, departure time in minutes
+}queryNode;
+
+typedef struct query{
+    queryNode nodes[QUERY_NODES];
+    int numNodes;
+    int root;
+    sortKey keys[7];    // ORDER BY, none keeps the display order
+    int nKeys;
+    int limit;          // LIMIT, -1 for every match
+}query;
+
+// Character classes used by parseRecord and the input validators, one table lookup per byte instead of a chain of comparisons
+#define CLASS_DIGIT 1
+#define CLASS_UPPER 2
+#define CLASS_SPACE 4
+#define CLASS_FIELD 8
+
+extern unsigned char charClass[256];
+void initCharClass();
+
+// Airport codes of up to 4 letters packed into an integer, as origin and destination are stored
+unsigned int packCode(const char *code);
+void unpackCode(unsigned int code, char text[5]);
+
+// Time strings
+bool validateTime(char time[], short *hour, short *minutes);
+void timecvtString(char *timeStr, short hour, short minutes);
+
+// Fixed size node allocator
+void initPool(slabPool *pool, size_t nodeSize, int nodesPerSlab);
+void *allocNode(slabPool *pool);
+void freeNode(slabPool *pool, void *node);
+void freePool(slabPool *pool);
+
+// Rows and their display order, positions are 0-based
+void initDB(flightDB *db);
+void freeDB(flightDB *db);
+void printMemoryStats(flightDB *db);
+void getRecord(flightDB *db, int row, dataSet *record);
+orderNode *seekOrder(flightDB *db, int position, int *slot);
+int rowAt(flightDB *db, int position);
+int positionOf(flightDB *db, int row);
+void orderRows(flightDB *db, int rows[]);
+void buildOrder(flightDB *db, int rows[], int n);
+void numberRows(flightDB *db);
+void appendDB(flightDB *db, dataSet *record);
+void insertDB(flightDB *db, int position, dataSet *record);
+void deleteDB(flightDB *db, int position);
+void updateDB(flightDB *db, int position, dataSet *record);
+void printTable(flightDB *db);
+
+// Dataset files
+int parseRecord(const char *p, const char *end, dataSet *record);
+void loadFile(FILE *fp, flightDB *db);
+void writeFile(flightDB *db, FILE *fp);
+bool loadSnapshot(flightDB *db, const char *snapshot, long long textSize);
+bool writeSnapshot(flightDB *db, const char *snapshot, long long textSize);
+void openDB(flightDB *db, FILE *fp, const char *path);
+
+// Parallel work
+int workerCount(void);
+void setWorkerCount(int n);
+void runParallel(int numTasks, void (*task)(void *context, int index, int worker), void *context);
+
+// Progressive load
+bool startLoad(flightDB *db, backgroundLoad *load, FILE *fp, const char *path);
+int loadProgress(backgroundLoad *load);
+int pollLoad(flightDB *db, backgroundLoad *load, bool wait);
+void stopLoad(backgroundLoad *load);
+
+// Journal of edits
+int replayJournal(flightDB *db, journal *log, FILE *base, const char *path, bool readOnly);
+void syncJournal(journal *log);
+int compactJournal(flightDB *db, journal *log);
+bool commitJournal(flightDB *db, journal *log);
+void closeJournal(flightDB *db, journal *log);
+
+// Background save
+bool startSave(flightDB *db, journal *log);
+int saveProgress(journal *log);
+int pollSave(flightDB *db, journal *log, bool wait);
+
+// Sorting, attributes are numbered 1-7 from flight number to stops
+void sortDBKeys(flightDB *db, sortKey keys[], int nKeys);
+void sortDB(flightDB *db, int option);
+
+// Searching, results are in display order except for searchRangeDB and the ORDER BY of queryDB
+int searchDB(flightDB *db, char input[], searchResult *result, int option);
+int narrowSearch(flightDB *db, searchResult *from, char input[], searchResult *result, int option);
+bool parseRoute(char input[], char origin[5], char destination[5]);
+int searchRouteDB(flightDB *db, char origin[], char destination[], searchResult *result);
+int searchExactDB(flightDB *db, char input[], searchResult *result);
+bool parseRange(char input[], int option, double *low, double *high);
+int searchRangeDB(flightDB *db, int option, double low, double high, searchResult *result);
+bool parseQuery(char input[], query *q);
+void matchCodes(const unsigned int codes[], int n, unsigned int code, unsigned long long bits[]);
+const char *codeKernel(void);
+int queryDB(flightDB *db, query *q, searchResult *result);
+void releaseSearch(flightDB *db, searchResult *result);
+void printSearch(flightDB *db, searchResult *result);
+
+#endif
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Synthetic dataset generator, writes rows in the DATASET_HEADER format
+// Usage: gen ROWS [SEED] > dataset.txt
+
+#define DATASET_HEADER "Flight number,origin,destination,capacity,departure time,price,stops,\n"
+
+// Carriers with their share of the flights, low cost carriers fly the most
+typedef struct carrier{
+    const char *code;
+    int weight;
+    int maxNumber;      // flight numbers are drawn from 1..maxNumber
+}carrier;
+
+static const carrier carriers[] = {
+    {"AK", 30, 6999}, {"OD", 12, 2999}, {"D7", 8, 999}, {"MH", 14, 2999}, {"SQ", 8, 999},
+    {"TG", 6, 999}, {"GA", 5, 999}, {"CX", 4, 999}, {"EK", 3, 499}, {"JL", 3, 999},
+    {"EY", 2, 499}, {"AI", 2, 999}, {"QF", 2, 999}, {"TR", 6, 2999}, {"3K", 4, 999},
+    {"VJ", 5, 1999}, {"5J", 4, 999}, {"QZ", 4, 999}, {"FD", 3, 3999}, {"XAX", 1, 99},
+};
+
+// Airports weighted by traffic, distance is a rough flying time in hours from KUL used to price the route
+typedef struct airport{
+    const char *code;
+    int weight;
+    double distance;
+}airport;
+
+static const airport airports[] = {
+    {"KUL", 40, 0.0}, {"SIN", 30, 1.0}, {"BKK", 22, 2.0}, {"HND", 14, 7.0}, {"NRT", 8, 7.0},
+    {"HKG", 14, 4.0}, {"TPE", 8, 4.5}, {"ICN", 10, 6.5}, {"DPS", 10, 3.0}, {"CGK", 16, 2.0},
+    {"JKT", 4, 2.0}, {"MNL", 10, 4.0}, {"SGN", 8, 2.0}, {"HAN", 6, 3.0}, {"PEN", 12, 1.0},
+    {"LGK", 6, 1.0}, {"KCH", 8, 1.8}, {"BKI", 8, 2.5}, {"SDK", 3, 2.7}, {"SBW", 3, 2.0},
+    {"PER", 6, 5.5}, {"SYD", 8, 8.0}, {"MEL", 6, 8.0}, {"DEL", 6, 5.5}, {"BOM", 5, 5.0},
+    {"DXB", 8, 7.0}, {"DOH", 4, 7.0}, {"LHR", 5, 14.0}, {"CDG", 3, 13.0}, {"JFK", 2, 19.0},
+    {"DUB", 1, 15.0}, {"PVG", 7, 5.5}, {"PEK", 5, 6.5}, {"CAN", 5, 4.0}, {"CTU", 3, 5.0},
+};
+
+// Seat counts of the common aircraft types
+static const short capacities[] = {70, 72, 90, 120, 150, 180, 186, 189, 220, 240, 270, 300, 360, 377, 420, 540};
+
+#define NUM_CARRIERS (int)(sizeof(carriers) / sizeof(carriers[0]))
+#define NUM_AIRPORTS (int)(sizeof(airports) / sizeof(airports[0]))
+#define NUM_CAPACITIES (int)(sizeof(capacities) / sizeof(capacities[0]))
+
+static unsigned long long state;
+
+// xorshift64*, the same seed always writes the same file
+unsigned long long nextRandom(){
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 2685821657736338717ULL;
+}
+
+// Uniform in [0, 1)
+double uniform(){
+    return (nextRandom() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Pick an index in proportion to weights
+int pickWeighted(const int weights[], int n, int total){
+    int r = nextRandom() % total;
+    for (int i = 0; i < n; i++){
+        if (r < weights[i])
+            return i;
+        r -= weights[i];
+    }
+    return n - 1;
+}
+
+// Departures cluster around the morning and evening banks, minutes are multiples of 5
+void departureTime(int *hour, int *minutes){
+    double u = uniform();
+    double t;
+    if (u < 0.4)
+        t = 8.0 + 1.8 * sqrt(-2.0 * log(1.0 - uniform())) * cos(6.283185307 * uniform());
+    else if (u < 0.75)
+        t = 18.5 + 1.6 * sqrt(-2.0 * log(1.0 - uniform())) * cos(6.283185307 * uniform());
+    else
+        t = 24.0 * uniform();
+    int m = ((int)(t * 60.0) % 1440 + 1440) % 1440;
+    m -= m % 5;
+    *hour = m / 60;
+    *minutes = m % 60;
+}
+
+int main(int argc, char *argv[]){
+    if (argc < 2){
+        fprintf(stderr, "Usage: %s ROWS [SEED] > dataset.txt\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    long rows = atol(argv[1]);
+    state = argc > 2 ? strtoull(argv[2], NULL, 10) : 1;
+    if (rows < 0 || state == 0){
+        fprintf(stderr, "Error: ROWS must not be negative and SEED must not be 0\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int carrierWeights[NUM_CARRIERS], airportWeights[NUM_AIRPORTS];
+    int totalCarriers = 0, totalAirports = 0;
+    for (int i = 0; i < NUM_CARRIERS; i++){
+        carrierWeights[i] = carriers[i].weight;
+        totalCarriers += carriers[i].weight;
+    }
+    for (int i = 0; i < NUM_AIRPORTS; i++){
+        airportWeights[i] = airports[i].weight;
+        totalAirports += airports[i].weight;
+    }
+
+    static char buffer[1 << 16];
+    setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+    fputs(DATASET_HEADER, stdout);
+    for (long i = 0; i < rows; i++){
+        const carrier *c = &carriers[pickWeighted(carrierWeights, NUM_CARRIERS, totalCarriers)];
+        int origin = pickWeighted(airportWeights, NUM_AIRPORTS, totalAirports);
+        int destination;
+        do{
+            destination = pickWeighted(airportWeights, NUM_AIRPORTS, totalAirports);
+        }while (destination == origin);
+
+        // Longer flights use bigger aircraft and make more stops
+        double hours = fabs(airports[origin].distance - airports[destination].distance) + 1.0;
+        int type = (int)(hours * 1.5 + uniform() * 6.0);
+        if (type >= NUM_CAPACITIES)
+            type = NUM_CAPACITIES - 1;
+        double u = uniform();
+        int stops = u < 0.7 ? 0 : (u < 0.92 ? 1 : (u < 0.98 ? 2 : 3));
+        if (hours > 8.0 && stops == 0 && uniform() < 0.4)
+            stops = 1;
+
+        // Fares grow with distance, spread log-normally and get cheaper with every stop
+        double price = (40.0 + 60.0 * hours) * exp(0.45 * sqrt(-2.0 * log(1.0 - uniform())) * cos(6.283185307 * uniform()));
+        price *= 1.0 - 0.12 * stops;
+
+        int hour, minutes;
+        departureTime(&hour, &minutes);
+        printf("%s %ld,%s,%s,%hd,%02d%02d,%.2f,%d,\n", c->code, 1 + (long)(nextRandom() % c->maxNumber),
+        airports[origin].code, airports[destination].code, capacities[type], hour, minutes, price, stops);
+    }
+    return 0;
+}
@@ -2,369 +2,170 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <limits.h>
 #include <ctype.h>
 #include <regex.h>
 #include <curses.h>
+#include <time.h>
 
-#define FILENAME "dataset"
-#define REGEX_EXPRESSION "^.{2,3}\\s[0-9]*,[A-Z]+,[A-Z]+,[0-9]+,[0-9]{4},(0|[1-9][0-9]*)(\\.[0-9]+)?,[0-9]{1},\n*.*$" // Narrow down acceptable char lengths to avoid overflow
+#include "flights.h"
 
 #define EXIT_SEARCH "Press 'q' to exit searching"
 #define EXIT_SEARCH_N 27
+#define SEARCH_HELP "Left & right select the attribute to search. 'e': exact flight 'r': route 'w': query"
 
 #define WRONG_FORMAT "Wrong Format! Please try again"
 #define WRONG_FORMAT_N 30
 
-#define DATASET_HEADER "Flight number,origin,destination,capacity,departure time,price,stops,\n"
-
-typedef struct dataSet{
-    char flightNumber[20];
-    char origin[5];
-    char destination[5];
-    short capacity;
-    short departureHour;
-    short departureMinutes;
-    float price;
-    short stops;
-    struct dataSet *nextNode;
-    struct dataSet *prevNode;
-}dataSet;
-
-// To rearrange original linked list by creating another layer of linked list, used by search function;
-typedef struct customOrder{
-    struct dataSet *element;
-    struct customOrder *nextElement;
-    struct customOrder *previousElement;
-}customOrder;
-
-// Return true lines in the files and return -1 if a empty line is found 
-int trueLinecount(FILE *fp){
-    char line[256]; //assume each line max is 256
-    int trueLine = 0;
-    int formatting_issue;
-
-    while (fgets(line, sizeof(line), fp) != NULL){
-        int i = 0;
-        
-        //move file pointer to a non white space character
-        while(isspace((unsigned char)line[i])){
-            if (line[i] == '\n'){
-                fclose(fp);
-                fprintf(stderr, "Error: blank line at line %d of %s\n", trueLine, FILENAME);
-                exit(EXIT_FAILURE);              }
-            i++;
-        }
-        // if character is \n then dont count the line
-        if (!isspace((unsigned char)line[i]) && line[i]!='\n'){
-            trueLine++;
-            // printf("%s", line);
-        }
-    }
-    printf("File Structure is Correct! File has %d lines\n", trueLine);
-    rewind(fp);
-    return trueLine;
-}
-
-// Validate the format of lines inside the file using regex
-int validateFile(FILE  *fp){
+// Field grammars used by the forms, each one is compiled once into a validator and reused by every prompt
+// The fixed grammars are matched by hand-written state machines, any other pattern falls back to a cached regex_t
+typedef struct validator{
+    const char *pattern;
+    bool (*match)(const char *input);   // NULL when regex holds the compiled pattern
     regex_t regex;
-    int reti = regcomp(&regex, REGEX_EXPRESSION , REG_EXTENDED);
-    int i = 1;
-    char line[256];
-
-    // validate format of each line and 
-    while (fgets(line, sizeof(line), fp) != NULL){
-        reti = regexec(&regex, line, 0, NULL, 0);
-        if (reti && i!=1){
-            regfree(&regex);
-            fclose(fp);
-            fprintf(stderr, "Error: format error at line %d of %s\n", i, FILENAME);
-            exit(EXIT_FAILURE);        
-        }
-        i++;
-    }
-    printf("Content Validation Successful!\n");
-    rewind(fp);
-    regfree(&regex);
-}
-
-// Return true if time is correct, split time in String to two hour and minutes in short
-bool validateTime(char time[], short *hour, short *minutes){
-    char temp[3];
-    strncpy(temp, time, 2), temp[2]='\0';
-    *hour = atoi(temp);
-    strncpy(temp, time+2, 2), temp[2]='\0';
-    *minutes = atoi(temp);
-
-    if (*minutes>= 0 && *minutes <= 59 && *hour>=0 && *hour<=23){
-        return true;
-    }else{
-        return false;
-    }
-}
+}validator;
 
-// combine hours and minutes to form a string
-void timecvtString(char *timeStr, short hour, short minutes){
-    sprintf(timeStr, "%02hd%02hd", hour, minutes);
-}
+#define MAX_VALIDATORS 32
 
-void printTable(dataSet *head){
-    dataSet *curr = head;
-    int i = 1;
-    printf("Num\tFlight Number\tOrigin\tDestination\tCapacity\tDeparture Time\tPrice\t\tStops\tPrev\tCurrent\t\tNext\n");
+static validator validators[MAX_VALIDATORS];
+static int numValidators = 0;
 
-    while(curr!= NULL){
-        printf("%d\t%s\t\t%s\t%s\t\t%hd\t\t%hd%hd\t\t%f\t%hd\t%p\t%p\t%p\n",i, curr->flightNumber, curr->origin, curr->destination, 
-        curr->capacity, curr->departureHour, curr->departureMinutes, curr->price, curr->stops, curr->prevNode,curr, curr->nextNode);
-        curr = curr->nextNode;
-        i++;
+// ^.{2,3}\s[0-9]*$  two or three characters of airline code, a space then the digits
+bool matchFlightNumber(const char *input){
+    for (int k = 2; k <= 3; k++){
+        int i = 0;
+        while (i < k && input[i] != '\0')
+            i++;
+        if (i < k || !((charClass[(unsigned char)input[k]] & CLASS_SPACE) || input[k] == '\n'))
+            continue;
+        for (i = k + 1; charClass[(unsigned char)input[i]] & CLASS_DIGIT; i++)
+            ;
+        if (input[i] == '\0')
+            return true;
     }
-    return;
+    return false;
 }
 
-// Print a custom order such as those returned by search function
-void printCustomOrder(customOrder *order){
-    int i = 1;
-    printf("Num\tFlight Number\tOrigin\tDestination\tCapacity\tDeparture Time\tPrice\t\tStops\tPrev\tCurrent\t\tNext\n");
-    while (order != NULL){
-        printf("%d\t%s\t\t%s\t%s\t\t%hd\t\t%hd%hd\t\t%f\t%hd\t%p\t%p\t%p\n", i, order->element->flightNumber, order->element->origin, order->element->destination,
-        order->element->capacity, order->element->departureHour, order->element->departureMinutes, order->element->price, order->element->stops, 
-        order->element->prevNode, order->element, order->element->nextNode);
-        order = order->nextElement;
+// ^[A-Z]+$
+bool matchCode(const char *input){
+    int i = 0;
+    while (charClass[(unsigned char)input[i]] & CLASS_UPPER)
         i++;
-    }
-    return;
+    return i > 0 && input[i] == '\0';
 }
 
-// Load file into a linked list memory
-dataSet *loadFile(FILE *fp, int lineCount){
-    char line[256], time[5];
-    dataSet temp;
-    bool err; 
+// ^[0-9]+$
+bool matchNumber(const char *input){
     int i = 0;
+    while (charClass[(unsigned char)input[i]] & CLASS_DIGIT)
+        i++;
+    return i > 0 && input[i] == '\0';
+}
 
-    dataSet *curr = (dataSet *)calloc(1, sizeof(dataSet));
-    dataSet *head = curr;
-    // printf("%p\n", head);
-    //jump to first newline
-    while( fgetc(fp) != '\n' ){}
-
-    for (i = 1; i <= lineCount-1; i++){
-
-        fgets(line, sizeof(line), fp);
-        sscanf(line, "%19[^,],%5[^,],%5[^,],%hd,%4[^,],%f,%hd", curr->flightNumber, curr->origin, curr->destination,
-               &(curr->capacity), time, &(curr->price), &(curr->stops));
-
-        err = validateTime(time, &(curr->departureHour), &(curr->departureMinutes));
-
-        if (!err){
-            fclose(fp);
-            fprintf(stderr, "Error: Date Format Error at line %d of %s\n",i+1, FILENAME);
-            exit(EXIT_FAILURE);
-        }
-        if (i != lineCount -1){
-            curr->nextNode = (dataSet *)calloc(1, sizeof(dataSet));
-            curr->nextNode->prevNode = curr;
-            curr = curr->nextNode;
-        }
-        // printf("%d\n", i);
-    }
-    // curr = head;
-    // printf("1 %s %p\n", curr->flightNumber, curr->nextNode);
-    // curr = curr->nextNode;
-    // printf("2 %s %p\n", curr->flightNumber, curr->nextNode);
-    // curr = curr->nextNode;    
-    // printf("3 %s %p\n", curr->flightNumber, curr->nextNode);
-    // curr = curr->nextNode;
-    // printf("4 %s %p\n", curr->flightNumber, curr->nextNode);
-    // curr = curr->nextNode;
-    // printf("5 %s %p\n", curr->flightNumber, curr->nextNode);
-    // curr = curr->nextNode;    
-    // printf("6 %s %p\n", curr->flightNumber, curr->nextNode);
-    // curr = curr->nextNode;
-    // printf("7 %s %p\n", curr->flightNumber, curr->nextNode);
-    // curr = curr->nextNode;
-    // printf("8 %s %p\n", curr->flightNumber, curr->nextNode);
-    // curr = curr->nextNode;    
-    // printf("9 %s %p\n", curr->flightNumber, curr->nextNode);
-    // curr = curr->nextNode;
-    // printf("10 %s %p\n", curr->flightNumber, curr->nextNode);
-
-    return head;
+// ^[0-9]{4}$
+bool matchTime(const char *input){
+    return matchNumber(input) && strlen(input) == 4;
 }
 
-// Swap nodeA and nodeB position, the head will be modified if neccessary nodeA is the head;
-void swap(dataSet **head, dataSet *nodeA, dataSet *nodeB){
-    nodeB->prevNode=nodeA->prevNode;
-    nodeA->nextNode=nodeB->nextNode;
-    if(nodeA->prevNode != NULL){
-        nodeA->prevNode->nextNode = nodeB;
-    }else{
-        *head = nodeB;
-    }
-    if(nodeB->nextNode != NULL){
-        nodeB->nextNode->prevNode = nodeA;
-    }
-    nodeA->prevNode = nodeB;
-    nodeB->nextNode = nodeA;
-    return;
+// ^[0-9]{1}$
+bool matchDigit(const char *input){
+    return (charClass[(unsigned char)input[0]] & CLASS_DIGIT) && input[1] == '\0';
 }
 
-// Bubble sort, option 1-7 controls what to be sorted
-void sortDB(dataSet **head, int option)
-{
-    dataSet *curr = *head;
-    bool swapped = false;
-    char str1[5], str2[5];
-    int result;
-    while (true){
-        if (curr->nextNode != NULL){
-            switch (option)
-            {
-            case 1:
-                result = strcmp(curr->flightNumber, curr->nextNode->flightNumber);
-                break;
-            case 2:
-                result = strcmp(curr->origin, curr->nextNode->origin);
-                break;
-            case 3:
-                result = strcmp(curr->destination, curr->nextNode->destination);
-                break;
-            case 4:
-                result = curr->capacity - curr->nextNode->capacity;
-                break;
-            case 5:
-                timecvtString(str1, curr->departureHour, curr->departureMinutes);
-                timecvtString(str2, curr->nextNode->departureHour, curr->nextNode->departureMinutes);
-                result = strcmp(str1, str2);
-            case 6:
-                result = curr->price - curr->nextNode->price;
-                break;
-            case 7:
-                result = curr->stops - curr->nextNode->stops;
-                break;
-            default:
-                break;
-            }
-            if (result > 0){
-                swap(head, curr, curr->nextNode);
-                swapped = true;
-            }
-            else{
-                curr = curr->nextNode;
-            }
-        }else{
-            if (swapped == true){
-                curr = *head;
-                swapped = false;
-            }else{
-                break;
-            }
+// ^(0|[1-9][0-9]*)(\.[0-9]+)?$
+bool matchPrice(const char *input){
+    enum {START, ZERO, INTEGER, POINT, FRACTION} state = START;
+    for (const char *p = input; *p != '\0'; p++){
+        bool digit = charClass[(unsigned char)*p] & CLASS_DIGIT;
+        switch (state){
+        case START:
+            if (!digit)
+                return false;
+            state = *p == '0' ? ZERO : INTEGER;
+            break;
+        case ZERO:
+        case INTEGER:
+            if (*p == '.')
+                state = POINT;
+            else if (!digit || state == ZERO)
+                return false;
+            break;
+        case POINT:
+        case FRACTION:
+            if (!digit)
+                return false;
+            state = FRACTION;
+            break;
         }
     }
+    return state == ZERO || state == INTEGER || state == FRACTION;
 }
 
-// Linear search using strstr function, return number of matches found
-// Use optiion to control what to search 1: Flight Number, 2: Origin, 3: Destination
-int searchDB(dataSet *head, char input[], customOrder **headSearch, int option){
-    customOrder *currSearch = (customOrder*)calloc(1,sizeof(customOrder));
-    *headSearch = currSearch;
-    dataSet *curr = head;
-    char *result;
-    bool isEmpty = true;
-    int numMatches = 0;
-    switch (option)
-    {
-    case 1:
-        while (curr != NULL)
-        {
-            result = strstr(curr->flightNumber, input);
-            // if the input is a substring
-            if (result != NULL)
-            {
-                currSearch->element = curr;
-                currSearch->nextElement = (customOrder *)calloc(1, sizeof(customOrder));
-                currSearch->nextElement->previousElement = currSearch;
-                currSearch = currSearch->nextElement;
-                isEmpty = false;
-                numMatches++;
-            }
-            curr = curr->nextNode;
-        }
-        break;
-    case 2:
-        while (curr != NULL)
-        {
-            result = strstr(curr->origin, input);
-            // if the input is a substring
-            if (result != NULL)
-            {
-                currSearch->element = curr;
-                currSearch->nextElement = (customOrder *)calloc(1, sizeof(customOrder));
-                currSearch->nextElement->previousElement = currSearch;
-                currSearch = currSearch->nextElement;
-                isEmpty = false;
-                numMatches++;
-            }
-            curr = curr->nextNode;
-        }
-        break;
-    case 3:
-        while (curr != NULL)
-        {
-            result = strstr(curr->destination, input);
-            // if the input is a substring
-            if (result != NULL)
-            {
-                currSearch->element = curr;
-                currSearch->nextElement = (customOrder *)calloc(1, sizeof(customOrder));
-                currSearch->nextElement->previousElement = currSearch;
-                currSearch = currSearch->nextElement;
-                isEmpty = false;
-                numMatches++;
-            }
-            curr = curr->nextNode;
-        }
-        break;
-    default:
-        break;
+// Patterns with a hand-written matcher, they must accept exactly what the regex accepts
+static const struct{
+    const char *pattern;
+    bool (*match)(const char *input);
+}machines[] = {
+    {"^.{2,3}\\s[0-9]*$", matchFlightNumber},
+    {"^[A-Z]+$", matchCode},
+    {"^[0-9]+$", matchNumber},
+    {"^[0-9]{4}$", matchTime},
+    {"^(0|[1-9][0-9]*)(\\.[0-9]+)?$", matchPrice},
+    {"^[0-9]{1}$", matchDigit},
+};
+
+// Find the validator of a pattern, compiling it the first time the pattern is seen
+validator *getValidator(const char *pattern){
+    for (int i = 0; i < numValidators; i++){
+        if (strcmp(validators[i].pattern, pattern) == 0)
+            return &validators[i];
     }
-    if (!isEmpty){
-        currSearch->previousElement->nextElement = NULL;
-        free(currSearch);
-    }else{
-        // If no match is found, delete first pointer and make it point to NULL
-        free(*headSearch);
-        *headSearch = NULL;
+    if (numValidators == MAX_VALIDATORS){
+        endwin();
+        fprintf(stderr, "Error: more than %d input patterns\n", MAX_VALIDATORS);
+        exit(EXIT_FAILURE);
+    }
+    if (numValidators == 0)
+        initCharClass();
+    validator *v = &validators[numValidators];
+    v->pattern = pattern;
+    v->match = NULL;
+    for (int i = 0; i < (int)(sizeof(machines) / sizeof(machines[0])); i++){
+        if (strcmp(machines[i].pattern, pattern) == 0)
+            v->match = machines[i].match;
     }
-    return numMatches;
+    if (v->match == NULL && regcomp(&v->regex, pattern, REG_EXTENDED | REG_NOSUB) != 0){
+        endwin();
+        fprintf(stderr, "Error: invalid input pattern %s\n", pattern);
+        exit(EXIT_FAILURE);
+    }
+    numValidators++;
+    return v;
 }
 
-void writeFile(dataSet *head, FILE *fp){
-    rewind(fp);
-    dataSet *curr = head;
-    char timeStr[5];
-
-    fprintf(fp, DATASET_HEADER);
+bool validate(validator *v, const char *input){
+    if (v->match != NULL)
+        return v->match(input);
+    return regexec(&v->regex, input, 0, NULL, 0) == 0;
+}
 
-    while(curr!= NULL){
-        timecvtString(timeStr, curr->departureHour, curr->departureMinutes);
-        fprintf(fp, "%s,%s,%s,%hd,%s,%.2f,%hd,\n", curr->flightNumber, curr->origin, curr->destination, 
-        curr->capacity, timeStr, curr->price, curr->stops);
-        curr = curr->nextNode;
+// Release the compiled regexes of the cache
+void freeValidators(){
+    for (int i = 0; i < numValidators; i++){
+        if (validators[i].match == NULL)
+            regfree(&validators[i].regex);
     }
-    return;
+    numValidators = 0;
 }
 
 // Input a string and validate it using 
 void inputandValidateStr(WINDOW *bottomMenu, char *validatedStr, char *regexExpressrion, int spacing, int maxX, bool initialErr)
 {
-    regex_t regex;
+    validator *v = getValidator(regexExpressrion);
     bool validated = false;
     bool firstErr = initialErr;
     while (!validated)
     {
-        int reti = regcomp(&regex, regexExpressrion, REG_EXTENDED);
         wmove(bottomMenu, 0, spacing);
         wclrtoeol(bottomMenu);
         if(firstErr){
@@ -372,8 +173,7 @@ void inputandValidateStr(WINDOW *bottomMenu, char *validatedStr, char *regexExpr
             wrefresh(bottomMenu);
         }
         mvwgetnstr(bottomMenu, 0, spacing, validatedStr, 9);
-        reti = regexec(&regex, validatedStr, 0, NULL, 0);
-        if (reti == 0)
+        if (validate(v, validatedStr))
         {
             validated = true;
         }else{
@@ -385,14 +185,12 @@ void inputandValidateStr(WINDOW *bottomMenu, char *validatedStr, char *regexExpr
 // Redundant function, placed for future use
 void inputandValidateShort(WINDOW *bottomMenu, short *validatedShort, char *regexExpressrion, int spacing, int maxX)
 {
-    regex_t regex;
+    validator *v = getValidator(regexExpressrion);
     char validatedStr[10];
-    int reti = regcomp(&regex, regexExpressrion, REG_EXTENDED);
     bool validated = false;
     bool firsrErr = false;
     while (!validated)
     {
-        int reti = regcomp(&regex, regexExpressrion, REG_EXTENDED);
         wmove(bottomMenu, 0, spacing);
         wclrtoeol(bottomMenu);
         if(firsrErr){
@@ -400,8 +198,7 @@ void inputandValidateShort(WINDOW *bottomMenu, short *validatedShort, char *rege
             wrefresh(bottomMenu);
         }
         mvwgetnstr(bottomMenu, 0, spacing, validatedStr, 9);
-        reti = regexec(&regex, validatedStr, 0, NULL, 0);
-        if (reti == 0)
+        if (validate(v, validatedStr))
         {
             *validatedShort = atoi(validatedStr);
             validated = true;
@@ -427,26 +224,218 @@ void inputValidateTime(WINDOW *bottomMenu, char *validatedStr, char *regexExpres
 }
 
 // Print the main UI, result is a key indicating which action has been pressed
-void cursesPrintMain(dataSet *head, WINDOW *main, WINDOW *bottomMenu,
-                     int displayableRows, int spacing, int numElement, int n_choices,
-                     int *menuItem, int *index, int *highlitedRow, int *key, char **choices, int n_attributes)
-{
+// What printRows last drew on a line of the table window, a line is drawn again only when one of these changes
+typedef struct screenLine{
+    int row;            // SCREEN_BLANK or SCREEN_UNKNOWN when no row is shown
+    int position;
+    bool highlighted;
+}screenLine;
+
+#define SCREEN_BLANK -1
+#define SCREEN_UNKNOWN -2
+
+// State of the table window and the keypress-to-paint measurement
+typedef struct renderState{
+    screenLine *lines;
+    int numLines;
+    int index;                  // first position on screen
+    unsigned long version;      // db->version the lines were drawn from
+    struct timespec keyTime;    // when the key being handled was read
+    bool keyPending;
+    int numKeys;
+    double totalLatency;        // milliseconds
+    double maxLatency;
+    long linesDrawn;
+    long linesSkipped;
+    long scrolls;
+}renderState;
+
+static renderState render;
+
+// Dataset, journal and file of the curses session, readKey stores the rows still being loaded
+// and shows how far their background save got
+static flightDB *session;
+static journal *sessionLog;
+static backgroundLoad *sessionLoad;
+static FILE *sessionFile;
+static const char *sessionPath;
+// Message for the status line, shown by the next draw of the main screen
+static char statusNotice[PATH_MAX + 128];
+
+// Forget what is on the table window, the next printRows draws every line
+void invalidateRows(void){
+    for (int i = 0; i < render.numLines; i++)
+        render.lines[i].row = SCREEN_UNKNOWN;
+}
+
+// Replay the journal over the rows of the file and journal every edit from here on
+void attachJournal(void){
+    replayJournal(session, sessionLog, sessionFile, sessionPath, false);
+    session->log = sessionLog;
+    snprintf(statusNotice, sizeof(statusNotice), "%s", sessionLog->notice);
+}
+
+// Show the progress of a background load or save at the right of the status line, return false once none is running
+bool showBackground(WINDOW *bottomMenu){
+    if (session == NULL)
+        return false;
+    int x = getmaxx(bottomMenu) - 24;
+    if (sessionLoad->running){
+        int status = pollLoad(session, sessionLoad, false);
+        wmove(bottomMenu, 0, x);
+        wclrtoeol(bottomMenu);
+        mvwprintw(bottomMenu, 0, x, "Loaded %d rows", session->numRows);
+        wrefresh(bottomMenu);
+        if (status == LOAD_RUNNING)
+            return true;
+        attachJournal();
+        return false;
+    }
+    int status = pollSave(session, sessionLog, false);
+    if (status == SAVE_IDLE)
+        return false;
+    wmove(bottomMenu, 0, x);
+    wclrtoeol(bottomMenu);
+    if (status == SAVE_RUNNING)
+        mvwprintw(bottomMenu, 0, x, "Saving %d%%", saveProgress(sessionLog));
+    else if (status == SAVE_DONE)
+        mvwprintw(bottomMenu, 0, x, "File has been saved!");
+    else
+        mvwprintw(bottomMenu, 0, x, "Error: save failed");
+    wrefresh(bottomMenu);
+    return status == SAVE_RUNNING;
+}
+
+// Wait for the rest of the file before an action that needs every row
+void waitForLoad(WINDOW *bottomMenu){
+    if (!sessionLoad->running)
+        return;
     wmove(bottomMenu, 0, 0);
     wclrtoeol(bottomMenu);
-    dataSet *curr = head;
+    mvwprintw(bottomMenu, 0, 0, "Waiting for the rest of the file...");
+    while (showBackground(bottomMenu))
+        ;
+}
 
-    // Scrolling mechanism
-    if (*index >= 0)
+// Read a key from the bottom menu, the time it arrives starts the keypress-to-paint measurement
+// While rows are loaded or a save runs in the background the wait wakes up to show its progress,
+// a load that ends returns KEY_REFRESH so that the caller draws the rows the journal changed
+int readKey(WINDOW *bottomMenu){
+    int key;
+    bool loading = sessionLoad->running;
+    // pollLoad waits for rows itself, a save only needs a look now and then
+    do{
+        wtimeout(bottomMenu, sessionLoad->running ? 0 : 100);
+    }while ((key = wgetch(bottomMenu)) == ERR && showBackground(bottomMenu));
+    wtimeout(bottomMenu, -1);
+    if (key == ERR)
+        key = loading ? KEY_REFRESH : wgetch(bottomMenu);
+    clock_gettime(CLOCK_MONOTONIC, &render.keyTime);
+    render.keyPending = true;
+    return key;
+}
+
+// Send every window staged with wnoutrefresh to the terminal in one update
+void paintScreen(void){
+    doupdate();
+    if (render.keyPending){
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double latency = (now.tv_sec - render.keyTime.tv_sec) * 1e3 + (now.tv_nsec - render.keyTime.tv_nsec) / 1e6;
+        render.numKeys++;
+        render.totalLatency += latency;
+        if (latency > render.maxLatency)
+            render.maxLatency = latency;
+        render.keyPending = false;
+    }
+}
+
+void printRenderStats(void){
+    printf("Keypress to paint\t%d keys\tavg %.3f ms\tmax %.3f ms\n", render.numKeys,
+    render.numKeys > 0 ? render.totalLatency / render.numKeys : 0.0, render.maxLatency);
+    printf("Table lines\t%ld drawn\t%ld unchanged\t%ld scrolls\n", render.linesDrawn, render.linesSkipped, render.scrolls);
+}
+
+// Print a screen of rows starting at position index, lines below the last row are cleared
+// rows is NULL to print the table in display order, otherwise it holds numRows rows such as a search result
+// Only lines whose row, position or highlight changed are drawn, a view moved by one row is scrolled first
+// The window is staged with wnoutrefresh, paintScreen sends it
+void printRows(flightDB *db, WINDOW *main, int rows[], int numRows, int displayableRows, int n_attributes, int spacing,
+               int index, int highlitedRow)
+{
+    if (render.numLines != displayableRows)
+    {
+        render.lines = (screenLine *)realloc(render.lines, displayableRows * sizeof(screenLine));
+        render.numLines = displayableRows;
+        invalidateRows();
+    }
+    if (render.version != db->version)
+    {
+        invalidateRows();
+        render.version = db->version;
+    }
+    int shift = index - render.index;
+    if ((shift == 1 || shift == -1) && displayableRows > 1)
     {
-        for (int k = 0; k < *index; k++)
+        // Let the terminal move the lines, only the line coming into view is left to draw
+        scrollok(main, TRUE);
+        wscrl(main, shift);
+        scrollok(main, FALSE);
+        if (shift == 1)
         {
-            curr = curr->nextNode;
+            memmove(&render.lines[0], &render.lines[1], (displayableRows - 1) * sizeof(screenLine));
+            render.lines[displayableRows - 1].row = SCREEN_BLANK;
         }
+        else
+        {
+            memmove(&render.lines[1], &render.lines[0], (displayableRows - 1) * sizeof(screenLine));
+            render.lines[0].row = SCREEN_BLANK;
+        }
+        render.scrolls++;
     }
-    // Print vertically
-    for (int i = 0; (i < displayableRows) && (curr != NULL); i++)
+    render.index = index;
+
+    // The table is walked leaf by leaf from the first visible position
+    int slot = 0;
+    orderNode *leaf = rows == NULL ? seekOrder(db, index, &slot) : NULL;
+    for (int i = 0; i < displayableRows; i++)
     {
-        if (*highlitedRow == i)
+        int position = index + i;
+        int row = SCREEN_BLANK;
+        if (position >= numRows)
+        {
+            position = SCREEN_BLANK;
+        }
+        else if (rows != NULL)
+        {
+            row = rows[position];
+        }
+        else
+        {
+            row = leaf->rows[slot++];
+            if (slot == leaf->numItems)
+            {
+                leaf = leaf->next;
+                slot = 0;
+            }
+        }
+        screenLine *line = &render.lines[i];
+        bool highlighted = row != SCREEN_BLANK && highlitedRow == i;
+        if (line->row == row && (row == SCREEN_BLANK || (line->position == position && line->highlighted == highlighted)))
+        {
+            render.linesSkipped++;
+            continue;
+        }
+        line->row = row;
+        line->position = position;
+        line->highlighted = highlighted;
+        render.linesDrawn++;
+
+        wmove(main, i, 0);
+        wclrtoeol(main);
+        if (row == SCREEN_BLANK)
+            continue;
+        if (highlighted)
         {
             wattron(main, A_REVERSE);
         }
@@ -458,39 +447,115 @@ void cursesPrintMain(dataSet *head, WINDOW *main, WINDOW *bottomMenu,
             switch (j)
             {
             case 0:
-                wprintw(main, "%d", (i + *index + 1));
+                wprintw(main, "%d", position + 1);
                 break;
             case 1:
-                wprintw(main, "%s", curr->flightNumber);
+                wprintw(main, "%s", db->flightNumber[row]);
                 break;
             case 2:
-                wprintw(main, "%s", curr->origin);
-                break;
             case 3:
-                wprintw(main, "%s", curr->destination);
+                char code[5];
+                unpackCode(j == 2 ? db->origin[row] : db->destination[row], code);
+                wprintw(main, "%s", code);
                 break;
             case 4:
-                wprintw(main, "%d", curr->capacity);
+                wprintw(main, "%d", db->capacity[row]);
                 break;
             case 5:
                 char timeStr[5];
-                timecvtString(timeStr, curr->departureHour, curr->departureMinutes);
+                timecvtString(timeStr, db->departureHour[row], db->departureMinutes[row]);
                 wprintw(main, "%s", timeStr);
                 break;
             case 6:
-                wprintw(main, "%.2f", curr->price);
+                wprintw(main, "%.2f", db->price[row]);
                 break;
             case 7:
-                wprintw(main, "%hd", curr->stops);
+                wprintw(main, "%hd", db->stops[row]);
                 break;
             default:
                 break;
             }
-            wrefresh(main);
         }
         wattroff(main, A_REVERSE);
-        curr = curr->nextNode;
     }
+    wnoutrefresh(main);
+}
+
+// PageUp, PageDown, Home and End for the table views, return false for any other key
+// Only index and highlitedRow change, the screen is then drawn from the order tree in O(log n)
+bool pageRows(int key, int displayableRows, int numRows, int *index, int *highlitedRow)
+{
+    switch (key)
+    {
+    case KEY_PPAGE:
+        if (*index == 0)
+            *highlitedRow = 0;
+        *index -= displayableRows;
+        break;
+    case KEY_NPAGE:
+        if (*index >= numRows - displayableRows)
+            *highlitedRow = displayableRows - 1;
+        *index += displayableRows;
+        break;
+    case KEY_HOME:
+        *index = 0;
+        *highlitedRow = 0;
+        break;
+    case KEY_END:
+        *index = numRows - displayableRows;
+        *highlitedRow = displayableRows - 1;
+        break;
+    default:
+        return false;
+    }
+    if (*index > numRows - displayableRows)
+        *index = numRows - displayableRows;
+    if (*index < 0)
+        *index = 0;
+    if (*highlitedRow > numRows - 1 - *index)
+        *highlitedRow = numRows - 1 - *index;
+    if (*highlitedRow < 0)
+        *highlitedRow = 0;
+    return true;
+}
+
+// Ask for a row number and scroll so that the row is highlighted at the top of the screen
+void goToRow(WINDOW *bottomMenu, int displayableRows, int numRows, int *index, int *highlitedRow)
+{
+    char input[10];
+    wmove(bottomMenu, 0, 0);
+    wclrtoeol(bottomMenu);
+    mvwprintw(bottomMenu, 0, 0, "Go to row (1-%d):", numRows);
+    nocbreak();
+    echo();
+    curs_set(1);
+    mvwgetnstr(bottomMenu, 0, 30, input, 9);
+    cbreak();
+    noecho();
+    curs_set(0);
+    wmove(bottomMenu, 0, 0);
+    wclrtoeol(bottomMenu);
+
+    int target = atoi(input);
+    if (target < 1 || target > numRows)
+        return;
+    *index = target - 1;
+    if (*index > numRows - displayableRows)
+        *index = numRows - displayableRows;
+    if (*index < 0)
+        *index = 0;
+    *highlitedRow = target - 1 - *index;
+}
+
+void cursesPrintMain(flightDB *db, WINDOW *main, WINDOW *bottomMenu,
+                     int displayableRows, int spacing, int numElement, int n_choices,
+                     int *menuItem, int *index, int *highlitedRow, int *key, char **choices, int n_attributes)
+{
+    wmove(bottomMenu, 0, 0);
+    wclrtoeol(bottomMenu);
+    mvwprintw(bottomMenu, 0, 0, "%s", statusNotice);
+    statusNotice[0] = '\0';
+    printRows(db, main, NULL, db->numRows, displayableRows, n_attributes, spacing, *index, *highlitedRow);
     // Draw the screen with a specific highlight from 0-4
     for (int i = 0; i < n_choices; i++)
     {
@@ -501,9 +566,9 @@ void cursesPrintMain(dataSet *head, WINDOW *main, WINDOW *bottomMenu,
         mvwprintw(bottomMenu, 1, i * spacing, choices[i]);
         wattroff(bottomMenu, A_REVERSE);
     }
-    // printw("%d", menuItem);
-    // refresh();
-    *key = wgetch(bottomMenu);
+    wnoutrefresh(bottomMenu);
+    paintScreen();
+    *key = readKey(bottomMenu);
     switch (*key)
     {
     case KEY_LEFT:
@@ -541,85 +606,48 @@ void cursesPrintMain(dataSet *head, WINDOW *main, WINDOW *bottomMenu,
         if (*highlitedRow > displayableRows - 1)
             *highlitedRow = displayableRows - 1;
         break;
+    case 'g':
+    case 'G':
+        goToRow(bottomMenu, displayableRows, db->numRows, index, highlitedRow);
+        break;
+    default:
+        pageRows(*key, displayableRows, db->numRows, index, highlitedRow);
+        break;
     }
 }
 
-void cursesPrintSort(dataSet **head, WINDOW *main, WINDOW *bottomMenu, WINDOW *attributeRow,
+void cursesPrintSort(flightDB *db, WINDOW *main, WINDOW *bottomMenu, WINDOW *attributeRow,
                      int displayableRows, int numElement, int n_choices, int n_attributes, int attributesSpacing,
                      int *menuItem, int *index, int *highlitedRow, int *key, char **choices, char **attributes)
 
 {
     int sortItem = 1;
     mvwprintw(bottomMenu, 0, 0, "Press left & right to the attribute to be sorted.\tPress 'q' to extt sorting");
-    wrefresh(bottomMenu);
-    dataSet *curr = *head;
-    bool sortAgain = false;
+    wnoutrefresh(bottomMenu);
+    bool sortAgain = false, descending = false;
+    // Keys chosen so far, Enter starts a new list and '+' appends a tie breaker
+    sortKey keys[7];
+    int nKeys = 0;
 
     do
     {
-        // Determine if need to sort or not and use sortItem to determine the attribute to be sorted
+        // Determine if need to sort or not and use keys to determine the attributes to be sorted
         if (sortAgain == true)
         {
-            sortDB(head, sortItem);
+            sortDBKeys(db, keys, nKeys);
             sortAgain = false;
-            curr = *head;
-        }
-        // Scrolling mechanism
-        if (*index > 0)
-        {
-            for (int k = 0; k < *index; k++)
-            {
-                curr = curr->nextNode;
-            }
-        }
-        // Print vertically
-        for (int i = 0; (i < displayableRows) && (curr != NULL); i++)
-        {
-            if (*highlitedRow == i)
-            {
-                wattron(main, A_REVERSE);
-            }
-            // Print horizontally
-            for (int j = 0; (j < n_attributes); j++)
+
+            wmove(bottomMenu, 0, 0);
+            wclrtoeol(bottomMenu);
+            mvwprintw(bottomMenu, 0, 0, "Sorted by");
+            for (int k = 0; k < nKeys; k++)
             {
-                wmove(main, i, j * attributesSpacing);
-                wclrtoeol(main);
-                switch (j)
-                {
-                case 0:
-                    wprintw(main, "%d", (i + *index + 1));
-                    break;
-                case 1:
-                    wprintw(main, "%s", curr->flightNumber);
-                    break;
-                case 2:
-                    wprintw(main, "%s", curr->origin);
-                    break;
-                case 3:
-                    wprintw(main, "%s", curr->destination);
-                    break;
-                case 4:
-                    wprintw(main, "%d", curr->capacity);
-                    break;
-                case 5:
-                    char timeStr[5];
-                    timecvtString(timeStr, curr->departureHour, curr->departureMinutes);
-                    wprintw(main, "%s", timeStr);
-                    break;
-                case 6:
-                    wprintw(main, "%.2f", curr->price);
-                    break;
-                case 7:
-                    wprintw(main, "%hd", curr->stops);
-                    break;
-                default:
-                    break;
-                }
-                wrefresh(main);
+                wprintw(bottomMenu, "%s %s%s", k == 0 ? "" : ",", attributes[keys[k].attribute], keys[k].descending ? " (desc)" : "");
             }
-            wattroff(main, A_REVERSE);
-            curr = curr->nextNode;
+            wprintw(bottomMenu, ".  '+': then by  'd': %s", descending ? "desc" : "asc");
+            wnoutrefresh(bottomMenu);
         }
+        printRows(db, main, NULL, db->numRows, displayableRows, n_attributes, attributesSpacing, *index, *highlitedRow);
         // Print the top attribute row
         for (int i = 0; i < n_attributes; i++)
         {
@@ -628,12 +656,12 @@ void cursesPrintSort(dataSet **head, WINDOW *main, WINDOW *bottomMenu, WINDOW *a
                 wattron(attributeRow, A_REVERSE);
             }
             mvwprintw(attributeRow, 0, i * attributesSpacing, attributes[i]);
-            wrefresh(attributeRow);
             wattroff(attributeRow, A_REVERSE);
         }
-        // printw("%d", menuItem);
-        // refresh();
-        *key = wgetch(bottomMenu);
+        wnoutrefresh(attributeRow);
+        wnoutrefresh(bottomMenu);
+        paintScreen();
+        *key = readKey(bottomMenu);
         switch (*key)
         {
         case KEY_LEFT:
@@ -673,316 +701,314 @@ void cursesPrintSort(dataSet **head, WINDOW *main, WINDOW *bottomMenu, WINDOW *a
                 *highlitedRow = displayableRows - 1;
             break;
         case '\n':
+            keys[0].attribute = sortItem;
+            keys[0].descending = descending;
+            nKeys = 1;
             sortAgain = true;
             *index = 0;
             *highlitedRow = 0;
             break;
+        case '+':
+            // Add the selected attribute as the next key unless it is already part of the order
+            sortAgain = true;
+            for (int k = 0; k < nKeys; k++)
+            {
+                if (keys[k].attribute == sortItem)
+                    sortAgain = false;
+            }
+            if (sortAgain)
+            {
+                keys[nKeys].attribute = sortItem;
+                keys[nKeys].descending = descending;
+                nKeys++;
+                *index = 0;
+                *highlitedRow = 0;
+            }
+            break;
+        case 'd':
+        case 'D':
+            descending = !descending;
+            mvwprintw(bottomMenu, 0, 0, "Next key will be sorted in %s order ", descending ? "descending" : "ascending");
+            wclrtoeol(bottomMenu);
+            wnoutrefresh(bottomMenu);
+            break;
+        case 'g':
+        case 'G':
+            goToRow(bottomMenu, displayableRows, db->numRows, index, highlitedRow);
+            break;
+        default:
+            pageRows(*key, displayableRows, db->numRows, index, highlitedRow);
+            break;
         }
-        curr = *head;
     } while (*key != 'q' && *key != 'Q');
 }
 
-void cursesPrintSearch(dataSet *head, WINDOW *main, WINDOW *bottomMenu, WINDOW *attributeRow,
+#define SEARCH_INPUT 16  // characters of a search query, and one result per prefix of it
+
+// Example shown in the prompt of a range search, by attribute
+static const char *rangeExamples[] = {"", "", "", "", "300-", "0700-0930", "100-250", "-1"};
+
+// Fill prefix[length] with the matches of input, whose shorter prefixes are already in prefix[1..length-1]
+// Substring searches narrow the previous prefix instead of starting again, exact, route and range lookups go to their index
+int typeSearch(flightDB *db, searchResult prefix[], char input[], int length, int searchItem, bool exactFlight, bool routeSearch)
+{
+    searchResult *result = &prefix[length];
+    char origin[5], destination[5];
+    result->numRows = 0;
+
+    if (input[0] == ' ')
+        return 0;
+    if (routeSearch)
+    {
+        if (parseRoute(input, origin, destination))
+            searchRouteDB(db, origin, destination, result);
+    }
+    else if (searchItem >= FIRST_RANGE_ATTRIBUTE)
+    {
+        double low, high;
+        if (parseRange(input, searchItem, &low, &high))
+            searchRangeDB(db, searchItem, low, high, result);
+    }
+    else if (exactFlight && searchItem == 1)
+        searchExactDB(db, input, result);
+    else if (length == 1)
+        searchDB(db, input, result, searchItem);
+    else
+        narrowSearch(db, &prefix[length - 1], input, result, searchItem);
+    return result->numRows;
+}
+
+// Ask for a query and run it into result, false when it cannot be parsed
+bool typeQuery(flightDB *db, WINDOW *bottomMenu, searchResult *result)
+{
+    char input[128];
+    query q;
+    wmove(bottomMenu, 0, 0);
+    wclrtoeol(bottomMenu);
+    mvwprintw(bottomMenu, 0, 0, "Query:");
+    nocbreak();
+    echo();
+    curs_set(1);
+    mvwgetnstr(bottomMenu, 0, 7, input, sizeof(input) - 1);
+    cbreak();
+    noecho();
+    curs_set(0);
+    wmove(bottomMenu, 0, 0);
+    wclrtoeol(bottomMenu);
+    if (!parseQuery(input, &q))
+        return false;
+    queryDB(db, &q, result);
+    return true;
+}
+
+void cursesPrintSearch(flightDB *db, WINDOW *main, WINDOW *bottomMenu, WINDOW *attributeRow,
                      int displayableRows, int numElement, int n_choices, int n_attributes, int attributesSpacing, int maxX,
                      int *menuItem, int *index, int *highlitedRow, int *key, char **choices, char **attributes)
 
 {
     int searchItem = 1, numMatches = 0;
-    mvwprintw(bottomMenu, 0, 0, "Press left & right to select attribute to be searched.");
+    bool exactFlight = false, routeSearch = false;
+    mvwprintw(bottomMenu, 0, 0, SEARCH_HELP);
     mvwprintw(bottomMenu, 0, maxX-EXIT_SEARCH_N, EXIT_SEARCH);
 
-    wrefresh(bottomMenu);
-    dataSet *curr = head;
-    customOrder *search, *currSearch;
+    wnoutrefresh(bottomMenu);
+    // Matches of every prefix typed so far, prefix[k] holds those of the first k characters so Backspace costs nothing
+    searchResult prefix[SEARCH_INPUT] = {0}, queryResult = {0};
+    searchResult *search = NULL;
     bool promptSearch = false, displaySearch = false;
-    char input[10];
+    char input[SEARCH_INPUT];
+    int length = 0;
 
     do
     {
-        // If search is pressed
+        // If search is pressed, search as you type until Enter or Esc
         if (promptSearch == true)
         {
             wmove(bottomMenu, 0, 0);
             wclrtoeol(bottomMenu);
 
-            mvwprintw(bottomMenu, 0, 0, "Search by %s:", attributes[searchItem]);
-            nocbreak();
-            echo();
+            if (routeSearch)
+                mvwprintw(bottomMenu, 0, 0, "Search by route (KUL HND):");
+            else if (searchItem >= FIRST_RANGE_ATTRIBUTE)
+                mvwprintw(bottomMenu, 0, 0, "Search %s (%s):", attributes[searchItem], rangeExamples[searchItem]);
+            else
+                mvwprintw(bottomMenu, 0, 0, "Search by %s%s:", attributes[searchItem], (exactFlight && searchItem == 1) ? " (exact)" : "");
+            // the query starts after the prompt, at column 30 at the earliest
+            int inputX = getcurx(bottomMenu) + 1 > 30 ? getcurx(bottomMenu) + 1 : 30;
             curs_set(1);
-            mvwgetnstr(bottomMenu, 0, 30, input, 9);
-            cbreak();
-            noecho();
+            length = 0;
+            input[0] = '\0';
+            search = NULL;
+            do
+            {
+                numMatches = search == NULL ? db->numRows : search->numRows;
+                printRows(db, main, search == NULL ? NULL : search->rows, numMatches, displayableRows, n_attributes, attributesSpacing, 0, 0);
+                wmove(bottomMenu, 0, inputX);
+                wclrtoeol(bottomMenu);
+                if (length > 0)
+                    mvwprintw(bottomMenu, 0, inputX + SEARCH_INPUT, "%d matches", numMatches);
+                mvwprintw(bottomMenu, 0, inputX, "%s", input);
+                wnoutrefresh(bottomMenu);
+                paintScreen();
+
+                *key = readKey(bottomMenu);
+                if ((*key == KEY_BACKSPACE || *key == 127 || *key == '\b') && length > 0)
+                {
+                    input[--length] = '\0';
+                    search = length == 0 ? NULL : &prefix[length];
+                }
+                else if (*key < 256 && isprint(*key) && length < SEARCH_INPUT - 1)
+                {
+                    input[length++] = *key;
+                    input[length] = '\0';
+                    typeSearch(db, prefix, input, length, searchItem, exactFlight, routeSearch);
+                    search = &prefix[length];
+                }
+            } while (*key != '\n' && *key != KEY_ENTER && *key != 27);
             curs_set(0);
-            // TODO: Use switch case to implement searching on various attributes
-            numMatches = 0;
-            if (input[0] != '\0' && input[0] != ' ')
+
+            numMatches = search == NULL ? 0 : search->numRows;
+            wmove(bottomMenu, 0, 0);
+            wclrtoeol(bottomMenu);
+            if (*key == 27)
             {
-                numMatches = searchDB(head, input, &search, searchItem);
+                displaySearch = false;
+                mvwprintw(bottomMenu, 0, 0, SEARCH_HELP);
             }
-            if (numMatches != 0)
+            else if (numMatches != 0)
             {
                 displaySearch = true;
-                ;
-                wmove(bottomMenu, 0, 0);
-                wclrtoeol(bottomMenu);
                 mvwprintw(bottomMenu, 0, 0, "%d matches has been found! Select any attribute to search again", numMatches);
-                wclear(main);
-                wrefresh(main);
-                mvwprintw(bottomMenu, 0, maxX - EXIT_SEARCH_N, EXIT_SEARCH);
-                wrefresh(bottomMenu);
             }
             else
             {
                 displaySearch = false;
-                wmove(bottomMenu, 0, 0);
-                wclrtoeol(bottomMenu);
                 mvwprintw(bottomMenu, 0, 0, "No match has been found! Press any key to continue");
-                wclear(main);
-                wrefresh(main);
+                printRows(db, main, NULL, 0, displayableRows, n_attributes, attributesSpacing, 0, 0);
+                wnoutrefresh(bottomMenu);
+                paintScreen();
                 wgetch(bottomMenu);
-                mvwprintw(bottomMenu, 0, 0, "Press left & right to select attribute to be searched.");
-                mvwprintw(bottomMenu, 0, maxX - EXIT_SEARCH_N, EXIT_SEARCH);
+                mvwprintw(bottomMenu, 0, 0, SEARCH_HELP);
             }
-
+            mvwprintw(bottomMenu, 0, maxX - EXIT_SEARCH_N, EXIT_SEARCH);
+            wnoutrefresh(bottomMenu);
             promptSearch = false;
-            currSearch = search;
         }
         // Display search result or display normal database
-        if (displaySearch)
+        numMatches = displaySearch ? search->numRows : db->numRows;
+        printRows(db, main, displaySearch ? search->rows : NULL, numMatches, displayableRows, n_attributes, attributesSpacing, *index, *highlitedRow);
+        // Print the top attribute row
+        for (int i = 0; i < n_attributes; i++)
         {
-            mvwprintw(bottomMenu, 0, maxX-EXIT_SEARCH_N, EXIT_SEARCH);
-            if (*index > 0)
-            {
-                for (int k = 0; k < *index; k++)
-                {
-                    currSearch = currSearch->nextElement;
-                }
-            }
-            // Print vertically
-            for (int i = 0; (i < displayableRows) && (currSearch != NULL); i++)
+            if (i == searchItem || (routeSearch && (i == 2 || i == 3)))
             {
-                if (*highlitedRow == i)
-                {
-                    wattron(main, A_REVERSE);
-                }
-                // Print horizontally
-                for (int j = 0; (j < numElement); j++)
-                {
-                    wmove(main, i, j * attributesSpacing);
-                    wclrtoeol(main);
-                    switch (j)
-                    {
-                    case 0:
-                        wprintw(main, "%d", (i + *index + 1));
-                        break;
-                    case 1:
-                        wprintw(main, "%s", currSearch->element->flightNumber);
-                        break;
-                    case 2:
-                        wprintw(main, "%s", currSearch->element->origin);
-                        break;
-                    case 3:
-                        wprintw(main, "%s", currSearch->element->destination);
-                        break;
-                    case 4:
-                        wprintw(main, "%d", currSearch->element->capacity);
-                        break;
-                    case 5:
-                        char timeStr[5];
-                        timecvtString(timeStr, currSearch->element->departureHour, currSearch->element->departureMinutes);
-                        wprintw(main, "%s", timeStr);
-                        break;
-                    case 6:
-                        wprintw(main, "%.2f", currSearch->element->price);
-                        break;
-                    case 7:
-                        wprintw(main, "%hd", currSearch->element->stops);
-                        break;
-                    default:
-                        break;
-                    }
-                    wrefresh(main);
-                }
-                wattroff(main, A_REVERSE);
-                currSearch = currSearch->nextElement;
-            }
-            // Print the top attribute row
-            for (int i = 0; i < n_attributes; i++)
-            {
-                if (i == searchItem)
-                {
-                    wattron(attributeRow, A_REVERSE);
-                }
-                mvwprintw(attributeRow, 0, i * attributesSpacing, attributes[i]);
-                wrefresh(attributeRow);
-                wattroff(attributeRow, A_REVERSE);
+                wattron(attributeRow, A_REVERSE);
             }
-            // printw("%d", menuItem);
-            // refresh();
-            *key = wgetch(bottomMenu);
-            switch (*key)
-            {
-            case KEY_LEFT:
-                searchItem--;
-                if (searchItem < 1)
-                    searchItem = 1;
-                break;
-            case KEY_RIGHT:
-                searchItem++;
-                if (searchItem > n_attributes - 5)
-                    searchItem = n_attributes - 5;
-                break;
-            case KEY_UP:
-                if (*highlitedRow != 0)
-                    (*highlitedRow)--;
-                else
-                    (*index)--;
-                if (*index < 0)
-                    *index = 0;
-                if (*highlitedRow < 0)
-                    *highlitedRow = 0;
-                break;
-            case KEY_DOWN:
-                if (*highlitedRow != displayableRows - 1)
-                    (*highlitedRow)++;
-                else
-                    (*index)++;
-                if (*index > numMatches - displayableRows)
-                    *index = numMatches - displayableRows;
-                if (*index < 0)
-                    *index = 0;
-                if (*highlitedRow > displayableRows - 1)
-                    *highlitedRow = displayableRows - 1;
-                if (*highlitedRow > numMatches - 1)
-                    *highlitedRow = numMatches - 1;
-                break;
-            case '\n':
-                promptSearch = true;
+            mvwprintw(attributeRow, 0, i * attributesSpacing, attributes[i]);
+            wattroff(attributeRow, A_REVERSE);
+        }
+        wnoutrefresh(attributeRow);
+        wnoutrefresh(bottomMenu);
+        paintScreen();
+        *key = readKey(bottomMenu);
+        switch (*key)
+        {
+        case KEY_LEFT:
+            routeSearch = false;
+            searchItem--;
+            if (searchItem < 1)
+                searchItem = 1;
+            break;
+        case KEY_RIGHT:
+            routeSearch = false;
+            searchItem++;
+            if (searchItem > n_attributes - 1)
+                searchItem = n_attributes - 1;
+            break;
+        case KEY_UP:
+            if (*highlitedRow != 0)
+                (*highlitedRow)--;
+            else
+                (*index)--;
+            if (*index < 0)
                 *index = 0;
+            if (*highlitedRow < 0)
                 *highlitedRow = 0;
-                break;
-            }
-            currSearch = search;
-        }else{
-            // Display normal database
-            if (*index > 0)
-            {
-                for (int k = 0; k < *index; k++)
-                {
-                    curr = curr->nextNode;
-                }
-            }
-            // Print vertically
-            for (int i = 0; (i < displayableRows) && (curr != NULL); i++)
-            {
-                if (*highlitedRow == i)
-                {
-                    wattron(main, A_REVERSE);
-                }
-                // Print horizontally
-                for (int j = 0; (j < numElement); j++)
-                {
-                    wmove(main, i, j * attributesSpacing);
-                    wclrtoeol(main);
-                    switch (j)
-                    {
-                    case 0:
-                        wprintw(main, "%d", (i + *index + 1));
-                        break;
-                    case 1:
-                        wprintw(main, "%s", curr->flightNumber);
-                        break;
-                    case 2:
-                        wprintw(main, "%s", curr->origin);
-                        break;
-                    case 3:
-                        wprintw(main, "%s", curr->destination);
-                        break;
-                    case 4:
-                        wprintw(main, "%d", curr->capacity);
-                        break;
-                    case 5:
-                        char timeStr[5];
-                        timecvtString(timeStr, curr->departureHour, curr->departureMinutes);
-                        wprintw(main, "%s", timeStr);
-                        break;
-                    case 6:
-                        wprintw(main, "%.2f", curr->price);
-                        break;
-                    case 7:
-                        wprintw(main, "%hd", curr->stops);
-                        break;
-                    default:
-                        break;
-                    }
-                    wrefresh(main);
-                }
-                wattroff(main, A_REVERSE);
-                curr = curr->nextNode;
-            }
-            // Print the top attribute row
-            for (int i = 0; i < n_attributes; i++)
-            {
-                if (i == searchItem)
-                {
-                    wattron(attributeRow, A_REVERSE);
-                }
-                mvwprintw(attributeRow, 0, i * attributesSpacing, attributes[i]);
-                wrefresh(attributeRow);
-                wattroff(attributeRow, A_REVERSE);
-            }
-            // printw("%d", menuItem);
-            // refresh();
-            *key = wgetch(bottomMenu);
-            switch (*key)
-            {
-            case KEY_LEFT:
-                searchItem--;
-                if (searchItem < 1)
-                    searchItem = 1;
-                break;
-            case KEY_RIGHT:
-                searchItem++;
-                if (searchItem > n_attributes - 5)
-                    searchItem = n_attributes - 5;
-                break;
-            case KEY_UP:
-                if (*highlitedRow != 0)
-                    (*highlitedRow)--;
-                else
-                    (*index)--;
-                if (*index < 0)
-                    *index = 0;
-                if (*highlitedRow < 0)
-                    *highlitedRow = 0;
-                break;
-            case KEY_DOWN:
-                if (*highlitedRow != displayableRows - 1)
-                    (*highlitedRow)++;
-                else
-                    (*index)++;
-                if (*index > numElement - displayableRows)
-                    *index = numElement - displayableRows;
-                if (*highlitedRow > displayableRows - 1)
-                    *highlitedRow = displayableRows - 1;
-                break;
-            case '\n':
-                promptSearch = true;
+            break;
+        case KEY_DOWN:
+            if (*highlitedRow != displayableRows - 1)
+                (*highlitedRow)++;
+            else
+                (*index)++;
+            if (*index > numMatches - displayableRows)
+                *index = numMatches - displayableRows;
+            if (*index < 0)
                 *index = 0;
-                *highlitedRow = 0;
-                break;
+            if (*highlitedRow > displayableRows - 1)
+                *highlitedRow = displayableRows - 1;
+            if (*highlitedRow > numMatches - 1)
+                *highlitedRow = numMatches - 1;
+            break;
+        case '\n':
+            promptSearch = true;
+            *index = 0;
+            *highlitedRow = 0;
+            break;
+        case 'e':
+        case 'E':
+            // Toggle whole flight number matching through the hash index
+            exactFlight = !exactFlight;
+            wmove(bottomMenu, 0, 0);
+            wclrtoeol(bottomMenu);
+            mvwprintw(bottomMenu, 0, 0, "Exact flight number match %s", exactFlight ? "on" : "off");
+            mvwprintw(bottomMenu, 0, maxX - EXIT_SEARCH_N, EXIT_SEARCH);
+            break;
+        case 'r':
+        case 'R':
+            // Search origin and destination together through the route index
+            routeSearch = true;
+            promptSearch = true;
+            *index = 0;
+            *highlitedRow = 0;
+            break;
+        case 'w':
+        case 'W':
+            // A whole query such as origin=KUL AND price<300 ORDER BY departure LIMIT 50, run on Enter
+            *index = 0;
+            *highlitedRow = 0;
+            displaySearch = false;
+            if (!typeQuery(db, bottomMenu, &queryResult))
+                mvwprintw(bottomMenu, 0, 0, "Not a query, e.g. origin=KUL AND price<300 ORDER BY departure LIMIT 50");
+            else if (queryResult.numRows == 0)
+                mvwprintw(bottomMenu, 0, 0, "No match has been found!");
+            else
+            {
+                search = &queryResult;
+                displaySearch = true;
+                mvwprintw(bottomMenu, 0, 0, "%d matches has been found! Select any attribute to search again", queryResult.numRows);
             }
-            curr = head;
+            mvwprintw(bottomMenu, 0, maxX - EXIT_SEARCH_N, EXIT_SEARCH);
+            break;
+        case 'g':
+        case 'G':
+            goToRow(bottomMenu, displayableRows, numMatches, index, highlitedRow);
+            mvwprintw(bottomMenu, 0, maxX - EXIT_SEARCH_N, EXIT_SEARCH);
+            break;
+        default:
+            pageRows(*key, displayableRows, numMatches, index, highlitedRow);
+            break;
         }
     } while (*key != 'q' && *key != 'Q');
+    for (int k = 0; k < SEARCH_INPUT; k++)
+        releaseSearch(db, &prefix[k]);
+    releaseSearch(db, &queryResult);
 }
 
-void cursesAdd(dataSet *head, WINDOW *main, WINDOW *bottomMenu, WINDOW *attributeRow,
+void cursesAdd(flightDB *db, WINDOW *main, WINDOW *bottomMenu, WINDOW *attributeRow,
                      int displayableRows, int n_choices, int n_attributes, int attributesSpacing, int maxX,
                      int *numElement, int *menuItem, int *index, int *highlitedRow, int *key, char **choices, char **attributes)
 {
-    dataSet *newEntry = (dataSet*)calloc(1,sizeof(dataSet));
-    dataSet *curr = head;
+    dataSet newEntry = {0};
     char temp[10];
     // taking input for 7 attributes
     for (int i = 1; i<= n_attributes -1; i++){
@@ -996,28 +1022,28 @@ void cursesAdd(dataSet *head, WINDOW *main, WINDOW *bottomMenu, WINDOW *attribut
         switch (i)
         {
         case 1:
-            inputandValidateStr(bottomMenu, newEntry->flightNumber, "^.{2,3}\\s[0-9]*$", 20, maxX, false);
+            inputandValidateStr(bottomMenu, newEntry.flightNumber, "^.{2,3}\\s[0-9]*$", 20, maxX, false);
             break;
         case 2:
-            inputandValidateStr(bottomMenu, newEntry->origin, "^[A-Z]+$", 20, maxX, false);
+            inputandValidateStr(bottomMenu, newEntry.origin, "^[A-Z]+$", 20, maxX, false);
             break;
         case 3:
-            inputandValidateStr(bottomMenu, newEntry->destination, "^[A-Z]+$", 20, maxX, false);
+            inputandValidateStr(bottomMenu, newEntry.destination, "^[A-Z]+$", 20, maxX, false);
             break;
         case 4:
             inputandValidateStr(bottomMenu, temp,"^[0-9]+$", 20, maxX, false);
-            newEntry->capacity = atoi(temp);
+            newEntry.capacity = atoi(temp);
             break;
         case 5:
-            inputValidateTime(bottomMenu, temp,"^[0-9]{4}$", 20, maxX, &(newEntry->departureHour), &(newEntry->departureMinutes));
+            inputValidateTime(bottomMenu, temp,"^[0-9]{4}$", 20, maxX, &(newEntry.departureHour), &(newEntry.departureMinutes));
             break;
         case 6:
             inputandValidateStr(bottomMenu, temp,"^(0|[1-9][0-9]*)(\\.[0-9]+)?$", 20, maxX, false);
-            newEntry->price = atof(temp);
+            newEntry.price = atof(temp);
             break;
         case 7:
             inputandValidateStr(bottomMenu, temp, "^[0-9]{1}$", 20, maxX, false);
-            newEntry->stops = atoi(temp);
+            newEntry.stops = atoi(temp);
             break;
         default:
             break;
@@ -1030,25 +1056,18 @@ void cursesAdd(dataSet *head, WINDOW *main, WINDOW *bottomMenu, WINDOW *attribut
     noecho();
     curs_set(0);
 
-    // Cyele to last node from head
-    while(curr->nextNode != NULL){
-        curr = curr->nextNode;
-    }
-    curr->nextNode = newEntry;
-    newEntry->prevNode = curr;
-    newEntry->nextNode = NULL;
+    appendDB(db, &newEntry);
 
     mvwprintw(bottomMenu, 0, 0, "New entry has been added! Press any key to continue");
     wgetch(bottomMenu);
-    (*numElement)++;
+    *numElement = db->numRows;
 }
 
-void cursesInsert(dataSet *head, WINDOW *main, WINDOW *bottomMenu, WINDOW *attributeRow,
+void cursesInsert(flightDB *db, WINDOW *main, WINDOW *bottomMenu, WINDOW *attributeRow,
                      int displayableRows, int n_choices, int n_attributes, int attributesSpacing, int maxX,
                      int *numElement, int *menuItem, int *index, int *highlitedRow, int *key, char **choices, char **attributes)
 {
-    dataSet *newEntry = (dataSet*)calloc(1,sizeof(dataSet));
-    dataSet *curr = head;
+    dataSet newEntry = {0};
     char temp[10];
     //taking input for 7 attributes
     for (int i = 1; i<= n_attributes -1; i++){
@@ -1062,28 +1081,28 @@ void cursesInsert(dataSet *head, WINDOW *main, WINDOW *bottomMenu, WINDOW *attri
         switch (i)
         {
         case 1:
-            inputandValidateStr(bottomMenu, newEntry->flightNumber, "^.{2,3}\\s[0-9]*$", 20, maxX, false);
+            inputandValidateStr(bottomMenu, newEntry.flightNumber, "^.{2,3}\\s[0-9]*$", 20, maxX, false);
             break;
         case 2:
-            inputandValidateStr(bottomMenu, newEntry->origin, "^[A-Z]+$", 20, maxX, false);
+            inputandValidateStr(bottomMenu, newEntry.origin, "^[A-Z]+$", 20, maxX, false);
             break;
         case 3:
-            inputandValidateStr(bottomMenu, newEntry->destination, "^[A-Z]+$", 20, maxX, false);
+            inputandValidateStr(bottomMenu, newEntry.destination, "^[A-Z]+$", 20, maxX, false);
             break;
         case 4:
             inputandValidateStr(bottomMenu, temp,"^[0-9]{4}$", 20, maxX, false);
-            newEntry->capacity = atoi(temp);
+            newEntry.capacity = atoi(temp);
             break;
         case 5:
-            inputValidateTime(bottomMenu, temp,"[0-9]{4}", 20, maxX, &(newEntry->departureHour), &(newEntry->departureMinutes));
+            inputValidateTime(bottomMenu, temp,"[0-9]{4}", 20, maxX, &(newEntry.departureHour), &(newEntry.departureMinutes));
             break;
         case 6:
             inputandValidateStr(bottomMenu, temp,"(0|[1-9][0-9]*)(\\.[0-9]+)?", 20, maxX, false);
-            newEntry->price = atof(temp);
+            newEntry.price = atof(temp);
             break;
         case 7:
             inputandValidateStr(bottomMenu, temp, "^[0-9]{1}$", 20, maxX, false);
-            newEntry->stops = atoi(temp);
+            newEntry.stops = atoi(temp);
             break;
         default:
             break;
@@ -1095,83 +1114,52 @@ void cursesInsert(dataSet *head, WINDOW *main, WINDOW *bottomMenu, WINDOW *attri
     cbreak();
     noecho();
     curs_set(0);
-    // strcpy(newEntry->flightNumber, "AAA 111");
-    // strcpy(newEntry->origin, "AAA");
-    // strcpy(newEntry->destination, "BBB");
-    // newEntry->departureHour = 12;
-    // newEntry->departureMinutes = 12;
-    // newEntry->capacity = 100;
-    // newEntry->price = 100.00;
-    // newEntry->stops = 1;  
-    
-    // Cyele to the current index
-    for (int k = 0; k < (*index + *highlitedRow); k++)
-    {
-        curr = curr->nextNode;
-    }
-    if(curr->nextNode == NULL){
-        curr->nextNode = newEntry;
-        newEntry->prevNode = curr;
-        newEntry->nextNode = NULL;
-    }else{
-        newEntry->nextNode = curr->nextNode;
-        curr->nextNode->prevNode = newEntry;
-        curr->nextNode = newEntry;
-        newEntry->prevNode = curr;
-    }
+
+    // Place the new entry right after the highlighted row
+    insertDB(db, *index + *highlitedRow + 1, &newEntry);
 
     mvwprintw(bottomMenu, 0, 0, "New entry has been inserted in line %d! Press any key to continue", *index + *highlitedRow +2);
     wgetch(bottomMenu);
-    (*numElement)++;
+    *numElement = db->numRows;
 }
 
-void cursesDelete(dataSet **head, WINDOW *main, WINDOW *bottomMenu, WINDOW *attributeRow,
+void cursesDelete(flightDB *db, WINDOW *main, WINDOW *bottomMenu, WINDOW *attributeRow,
                      int displayableRows, int n_choices, int n_attributes, int attributesSpacing, int maxX,
                      int *numElement, int *menuItem, int *index, int *highlitedRow, int *key, char **choices, char **attributes)
 {
-    dataSet *curr = *head;
-
-    // Cyele to the current index
-    for (int k = 0; k < (*index + *highlitedRow); k++)
-    {
-        curr = curr->nextNode;
+    if (db->numRows == 0){
+        mvwprintw(bottomMenu, 0, 0, "There is no entry to delete! Press any key to continue");
+        wgetch(bottomMenu);
+        return;
     }
 
-    // if the head is to be deleted
-    if (curr->prevNode == NULL){
-        *(head) = curr->nextNode;
-        (*head)->prevNode = NULL;
-        free(curr);
-    }else if(curr->nextNode == NULL){
-        // if the last element is to be deleted
-        curr->prevNode->nextNode = NULL;
-        free(curr);
-    }else{
-        // Normal deletion
-        curr->prevNode->nextNode = curr->nextNode;
-        curr->nextNode->prevNode = curr->prevNode;
-        free(curr);
-    }
+    deleteDB(db, *index + *highlitedRow);
 
+    // Keep the highlight on an existing row when the last row was deleted
+    if (*index + *highlitedRow >= db->numRows){
+        if (*highlitedRow > 0)
+            (*highlitedRow)--;
+        else if (*index > 0)
+            (*index)--;
+    }
 
     mvwprintw(bottomMenu, 0, 0, "Entry has been deleted ! Press any key to continue");
     wgetch(bottomMenu);
-    (*numElement)--;
+    *numElement = db->numRows;
 }
 
-void cursesUpdate(dataSet *head, WINDOW *main, WINDOW *bottomMenu, WINDOW *attributeRow,
+void cursesUpdate(flightDB *db, WINDOW *main, WINDOW *bottomMenu, WINDOW *attributeRow,
                      int displayableRows, int n_choices, int n_attributes, int attributesSpacing, int maxX,
                      int *numElement, int *menuItem, int *index, int *highlitedRow, int *key, char **choices, char **attributes)
 {
-    dataSet *newEntry = (dataSet*)calloc(1,sizeof(dataSet));
-    dataSet *curr = head;
+    dataSet newEntry = {0};
     char temp[10];
-    // Cyele to the current index
-    for (int 
-    k = 0; k < (*index + *highlitedRow); k++)
-    {
-        curr = curr->nextNode;
+    if (db->numRows == 0){
+        mvwprintw(bottomMenu, 0, 0, "There is no entry to update! Press any key to continue");
+        wgetch(bottomMenu);
+        return;
     }
+    int row = rowAt(db, *index + *highlitedRow);
     //taking input for 7 attributes
     for (int i = 1; i<= n_attributes -1; i++){
         wmove(bottomMenu, 0, 0);
@@ -1186,35 +1174,37 @@ void cursesUpdate(dataSet *head, WINDOW *main, WINDOW *bottomMenu, WINDOW *attri
         switch (i)
         {
         case 1:
-            mvwprintw(bottomMenu, 1, 0, "Current Value: %s", curr->flightNumber);
-            inputandValidateStr(bottomMenu, newEntry->flightNumber, ".{2,3}\\s[0-9]*", 20, maxX, false);
+            mvwprintw(bottomMenu, 1, 0, "Current Value: %s", db->flightNumber[row]);
+            inputandValidateStr(bottomMenu, newEntry.flightNumber, ".{2,3}\\s[0-9]*", 20, maxX, false);
             break;
         case 2:
-            mvwprintw(bottomMenu, 1, 0, "Current Value: %s", curr->origin);
-            inputandValidateStr(bottomMenu, newEntry->origin, "[A-Z]+", 20, maxX, false);
+            unpackCode(db->origin[row], temp);
+            mvwprintw(bottomMenu, 1, 0, "Current Value: %s", temp);
+            inputandValidateStr(bottomMenu, newEntry.origin, "[A-Z]+", 20, maxX, false);
             break;
         case 3:
-            mvwprintw(bottomMenu, 1, 0, "Current Value: %s", curr->destination);
-            inputandValidateStr(bottomMenu, newEntry->destination, "[A-Z]+", 20, maxX, false);
+            unpackCode(db->destination[row], temp);
+            mvwprintw(bottomMenu, 1, 0, "Current Value: %s", temp);
+            inputandValidateStr(bottomMenu, newEntry.destination, "[A-Z]+", 20, maxX, false);
             break;
         case 4:
-            mvwprintw(bottomMenu, 1, 0, "Current Value: %hd", curr->capacity);
+            mvwprintw(bottomMenu, 1, 0, "Current Value: %hd", db->capacity[row]);
             inputandValidateStr(bottomMenu, temp,"[0-9]+", 20, maxX, false);
-            newEntry->capacity = atoi(temp);
+            newEntry.capacity = atoi(temp);
             break;
         case 5:
-            mvwprintw(bottomMenu, 1, 0, "Current Value: %hd%hd", curr->departureHour, curr->departureMinutes);
-            inputValidateTime(bottomMenu, temp,"[0-9]{4}", 20, maxX, &(newEntry->departureHour), &(newEntry->departureMinutes));
+            mvwprintw(bottomMenu, 1, 0, "Current Value: %hd%hd", db->departureHour[row], db->departureMinutes[row]);
+            inputValidateTime(bottomMenu, temp,"[0-9]{4}", 20, maxX, &(newEntry.departureHour), &(newEntry.departureMinutes));
             break;
         case 6:
-            mvwprintw(bottomMenu, 1, 0, "Current Value: %.2f", curr->price);
+            mvwprintw(bottomMenu, 1, 0, "Current Value: %.2f", db->price[row]);
             inputandValidateStr(bottomMenu, temp,"(0|[1-9][0-9]*)(\\.[0-9]+)?", 20, maxX, false);
-            newEntry->price = atof(temp);
+            newEntry.price = atof(temp);
             break;
         case 7:
-            mvwprintw(bottomMenu, 1, 0, "Current Value: %hd", curr->stops);
+            mvwprintw(bottomMenu, 1, 0, "Current Value: %hd", db->stops[row]);
             inputandValidateStr(bottomMenu, temp, "[0-9]{1}", 20, maxX, false);
-            newEntry->stops = atoi(temp);
+            newEntry.stops = atoi(temp);
             break;
         default:
             break;
@@ -1227,24 +1217,297 @@ void cursesUpdate(dataSet *head, WINDOW *main, WINDOW *bottomMenu, WINDOW *attri
     noecho();
     curs_set(0);
 
-    strcpy(curr->flightNumber, newEntry->flightNumber);
-    strcpy(curr->origin, newEntry->origin);
-    strcpy(curr->destination, newEntry->destination);
-    curr->capacity = newEntry->capacity;
-    curr->departureHour = newEntry->departureHour;
-    curr->departureMinutes = newEntry->departureMinutes;
-    curr->price = newEntry->price;
-    curr->stops = newEntry->stops;
+    updateDB(db, *index + *highlitedRow, &newEntry);
 
-    mvwprintw(bottomMenu, 0, 0, "New entry has been updated in line %d! Press any key to continue", *index + *highlitedRow +2);
+    mvwprintw(bottomMenu, 0, 0, "New entry has been updated in line %d! Press any key to continue", *index + *highlitedRow +1);
     wgetch(bottomMenu);
-    (*numElement)++;
+    *numElement = db->numRows;
     wmove(bottomMenu, 1, 0);
     wclrtoeol(bottomMenu);
 }
 
-int main ()
+// Attribute names of the command line in the 1-7 numbering of sortDB and searchDB
+static const char *attributeNames[] = {"", "flight", "origin", "destination", "capacity", "departure", "price", "stops"};
+
+int attributeNumber(const char *name, int length){
+    for (int i = 1; i < 8; i++){
+        if ((int)strlen(attributeNames[i]) == length && strncmp(attributeNames[i], name, length) == 0)
+            return i;
+    }
+    if (length == 4 && strncmp(name, "time", 4) == 0)
+        return 5;
+    return 0;
+}
+
+// Write a row in the dataset format, preceded by its 1-based display position
+void printRecord(FILE *out, flightDB *db, int position, int row){
+    char timeStr[5], origin[5], destination[5];
+    timecvtString(timeStr, db->departureHour[row], db->departureMinutes[row]);
+    unpackCode(db->origin[row], origin);
+    unpackCode(db->destination[row], destination);
+    fprintf(out, "%d,%s,%s,%s,%hd,%s,%.2f,%hd,\n", position + 1, db->flightNumber[row], origin, destination,
+    db->capacity[row], timeStr, db->price[row], db->stops[row]);
+}
+
+// Write the rows of a search result in its order, the number of matches goes to stderr
+void printResult(flightDB *db, searchResult *result){
+    for (int i = 0; i < result->numRows; i++)
+        printRecord(stdout, db, positionOf(db, result->rows[i]), result->rows[i]);
+    fprintf(stderr, "%d matches\n", result->numRows);
+}
+
+// Read a record typed as a dataset line, the trailing comma may be left out
+bool parseLine(char *line, dataSet *record){
+    char buffer[128];
+    int length = strlen(line);
+    if (length == 0 || length > 120)
+        return false;
+    memcpy(buffer, line, length);
+    if (buffer[length - 1] != ',')
+        buffer[length++] = ',';
+    buffer[length] = '\0';
+    initCharClass();
+    return parseRecord(buffer, buffer + length, record) == PARSE_OK;
+}
+
+// Read "N rest" into a 1-based position turned 0-based, rest points after the blanks following N
+bool parsePosition(char *argument, int *position, char **rest){
+    char *end;
+    long n = strtol(argument, &end, 10);
+    if (end == argument || n < 1 || n > INT_MAX)
+        return false;
+    while (*end == ' ')
+        end++;
+    *position = (int)n - 1;
+    *rest = end;
+    return true;
+}
+
+// Run one batch command on the loaded dataset, results are written to stdout
+// Commands: sort ATTR[:desc][,ATTR...]  search FIELD=TEXT  query QUERY  delete N  insert N LINE  add LINE  update N LINE  print  save  stats
+bool runCommand(flightDB *db, journal *log, char *command, char *argument){
+    dataSet record;
+    int position;
+    char *rest;
+
+    if (strcmp(command, "sort") == 0){
+        sortKey keys[7];
+        int nKeys = 0;
+        for (char *p = argument; *p != '\0' && nKeys < 7;){
+            int length = strcspn(p, ",:");
+            keys[nKeys].attribute = attributeNumber(p, length);
+            keys[nKeys].descending = false;
+            if (keys[nKeys].attribute == 0)
+                return false;
+            p += length;
+            if (strncmp(p, ":desc", 5) == 0){
+                keys[nKeys].descending = true;
+                p += 5;
+            }
+            if (*p == ',')
+                p++;
+            nKeys++;
+        }
+        if (nKeys == 0)
+            return false;
+        sortDBKeys(db, keys, nKeys);
+    }else if (strcmp(command, "search") == 0){
+        searchResult result = {0};
+        char *value = strchr(argument, '=');
+        if (value == NULL)
+            return false;
+        *value++ = '\0';
+        if (strcmp(argument, "exact") == 0){
+            searchExactDB(db, value, &result);
+        }else if (strcmp(argument, "route") == 0){
+            char origin[5], destination[5];
+            if (!parseRoute(value, origin, destination))
+                return false;
+            searchRouteDB(db, origin, destination, &result);
+        }else{
+            int option = attributeNumber(argument, strlen(argument));
+            double low, high;
+            if (option >= FIRST_RANGE_ATTRIBUTE){
+                if (!parseRange(value, option, &low, &high))
+                    return false;
+                searchRangeDB(db, option, low, high, &result);
+            }else if (option >= 1){
+                searchDB(db, value, &result, option);
+            }else{
+                return false;
+            }
+        }
+        printResult(db, &result);
+        releaseSearch(db, &result);
+    }else if (strcmp(command, "query") == 0){
+        searchResult result = {0};
+        query q;
+        if (!parseQuery(argument, &q))
+            return false;
+        queryDB(db, &q, &result);
+        printResult(db, &result);
+        releaseSearch(db, &result);
+    }else if (strcmp(command, "delete") == 0){
+        if (!parsePosition(argument, &position, &rest) || *rest != '\0' || position >= db->numRows)
+            return false;
+        deleteDB(db, position);
+    }else if (strcmp(command, "insert") == 0 || strcmp(command, "update") == 0){
+        if (!parsePosition(argument, &position, &rest) || !parseLine(rest, &record))
+            return false;
+        if (command[0] == 'i' && position <= db->numRows)
+            insertDB(db, position, &record);
+        else if (command[0] == 'u' && position < db->numRows)
+            updateDB(db, position, &record);
+        else
+            return false;
+    }else if (strcmp(command, "add") == 0){
+        if (!parseLine(argument, &record))
+            return false;
+        appendDB(db, &record);
+    }else if (strcmp(command, "print") == 0){
+        int slot, i = 0;
+        for (orderNode *leaf = seekOrder(db, 0, &slot); leaf != NULL; leaf = leaf->next){
+            for (slot = 0; slot < leaf->numItems; slot++)
+                printRecord(stdout, db, i++, leaf->rows[slot]);
+        }
+    }else if (strcmp(command, "save") == 0){
+        return compactJournal(db, log) == SAVE_DONE;
+    }else if (strcmp(command, "stats") == 0){
+        printMemoryStats(db);
+    }else{
+        return false;
+    }
+    return true;
+}
+
+// Commands of the command line take one argument, insert and update take a position and a line
+int commandArguments(const char *command){
+    if (strcmp(command, "insert") == 0 || strcmp(command, "update") == 0)
+        return 2;
+    if (strcmp(command, "print") == 0 || strcmp(command, "save") == 0 || strcmp(command, "stats") == 0)
+        return 0;
+    return 1;
+}
+
+// Commands of the command line besides --file, --time and --script
+static const char *batchCommands[] = {"sort", "search", "query", "delete", "insert", "add", "update", "print", "save", "stats"};
+
+bool batchCommand(const char *command){
+    for (int i = 0; i < (int)(sizeof(batchCommands) / sizeof(batchCommands[0])); i++){
+        if (strcmp(command, batchCommands[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Time and run a command, a command that cannot be run stops the batch
+void runTimedCommand(flightDB *db, journal *log, char *command, char *argument, bool timing){
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (!runCommand(db, log, command, argument)){
+        fprintf(stderr, "Error: cannot run %s %s\n", command, argument);
+        exit(EXIT_FAILURE);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (timing)
+        fprintf(stderr, "%s\t%.3f ms\n", command, (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+}
+
+// Headless mode: main --file dataset.txt [--time] [--sort price] [--search origin=KUL] [--delete 42] [--save] [--script]
+// Options run in the order given, --script reads one command per line from stdin, for example "search route=KUL HND"
+int runBatch(int argc, char *argv[]){
+    FILE *fp = NULL;
+    const char *path = NULL;
+    bool timing = false;
+    flightDB db;
+    // edits of a batch are not journaled, they reach the dataset with --save
+    journal log;
+    initDB(&db);
+
+    for (int i = 1; i < argc; i++){
+        if (strncmp(argv[i], "--", 2) != 0){
+            fprintf(stderr, "Error: unexpected argument %s\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+        char *command = argv[i] + 2;
+        if (strcmp(command, "time") == 0){
+            timing = true;
+            continue;
+        }
+        if (strcmp(command, "file") == 0){
+            if (fp != NULL || i + 1 >= argc){
+                fprintf(stderr, "Error: --file needs exactly one file\n");
+                exit(EXIT_FAILURE);
+            }
+            path = argv[++i];
+            fp = fopen(path, "r+");
+            if (!fp){
+                perror("Error Opening File");
+                exit(EXIT_FAILURE);
+            }
+            struct timespec start, end;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            openDB(&db, fp, path);
+            // the journal is only read, a batch never creates it and --save removes it with its edits saved
+            replayJournal(&db, &log, fp, path, true);
+            if (log.notice[0] != '\0')
+                fprintf(stderr, "%s\n", log.notice);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            if (timing)
+                fprintf(stderr, "load\t%.3f ms\n", (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+            continue;
+        }
+        if (strcmp(command, "script") != 0 && !batchCommand(command)){
+            fprintf(stderr, "Error: unknown option --%s\n", command);
+            fprintf(stderr, "Usage: %s --file FILE [--time] [--sort ATTR] [--search FIELD=TEXT] [--query QUERY] [--delete N] [--insert N LINE] [--add LINE] [--update N LINE] [--print] [--save] [--stats] [--script]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        if (fp == NULL){
+            fprintf(stderr, "Error: --file must come before --%s\n", command);
+            exit(EXIT_FAILURE);
+        }
+        if (strcmp(command, "script") == 0){
+            char line[256];
+            while (fgets(line, sizeof(line), stdin) != NULL){
+                line[strcspn(line, "\r\n")] = '\0';
+                char *name = line + strspn(line, " \t");
+                if (*name == '\0' || *name == '#')
+                    continue;
+                char *argument = name + strcspn(name, " \t");
+                if (*argument != '\0')
+                    *argument++ = '\0';
+                runTimedCommand(&db, &log, name, argument, timing);
+            }
+            continue;
+        }
+        int n = commandArguments(command);
+        if (i + n >= argc){
+            fprintf(stderr, "Error: --%s needs %d argument%s\n", command, n, n == 1 ? "" : "s");
+            exit(EXIT_FAILURE);
+        }
+        char argument[256] = "";
+        if (n == 1)
+            snprintf(argument, sizeof(argument), "%s", argv[i + 1]);
+        else if (n == 2)
+            snprintf(argument, sizeof(argument), "%s %s", argv[i + 1], argv[i + 2]);
+        i += n;
+        runTimedCommand(&db, &log, command, argument, timing);
+    }
+    if (fp == NULL){
+        fprintf(stderr, "Error: no --file given\n");
+        exit(EXIT_FAILURE);
+    }
+    closeJournal(&db, &log);
+    freeDB(&db);
+    return 0;
+}
+
+int main (int argc, char *argv[])
 {
+    // Any option runs the headless batch mode instead of the curses interface
+    if (argc > 1)
+        return runBatch(argc, argv);
+
     char filename[100];
     printf("Please enter a file to open:\t");
     scanf("%s", filename);
@@ -1255,14 +1518,26 @@ int main ()
         exit(EXIT_FAILURE);
     }
 
-    int lineCount = trueLinecount(fp);
-    validateFile(fp);
-
-    dataSet *db = loadFile(fp, lineCount);
-    int numElement = lineCount - 1;
+    flightDB db;
+    initDB(&db);
+    // a text file is read on a producer thread while the first screen is up
+    backgroundLoad load;
+    journal log;
+    memset(&log, 0, sizeof(journal));
+    session = &db;
+    sessionLog = &log;
+    sessionLoad = &load;
+    sessionFile = fp;
+    sessionPath = filename;
+    // every edit from the end of the load on is journaled
+    if (!startLoad(&db, &load, fp, filename))
+        attachJournal();
+    int numElement = db.numRows;
 
     // Initialize ncurses
     initscr(); noecho(); cbreak(); start_color(); curs_set(0);
+    // Esc cancels a search, do not wait a second for the rest of an escape sequence
+    set_escdelay(25);
     init_pair(1, COLOR_WHITE, COLOR_BLACK);
     init_pair(2, COLOR_BLACK, COLOR_WHITE);
     init_pair(3, COLOR_WHITE, COLOR_BLUE);
@@ -1322,24 +1597,41 @@ int main ()
 
     WINDOW *main = newwin(displayableRows, maxX, 1, 0);
     wbkgd(main, COLOR_PAIR(1));
+    // Allow doupdate to use insert/delete line and scroll regions when printRows scrolls the table
+    idlok(main, TRUE);
     wrefresh(main);
+    // the first screen is drawn as soon as its rows are there
+    while (db.numRows < displayableRows && showBackground(bottomMenu))
+        ;
 
     while (1)
     {
+        // make the edits of the last action durable before waiting for the next one
+        syncJournal(&log);
         do
         {
+            // rows keep coming while the file loads
+            numElement = db.numRows;
             // Main display UI
-            cursesPrintMain(db, main, bottomMenu, 
+            cursesPrintMain(&db, main, bottomMenu, 
             displayableRows, attributesSpacing, numElement, n_choices, 
             &menuItem, &index, &highlitedRow, &key, choices, n_attributes);
  
         } while (key != '\n');
 
+        // every action but quitting works on the whole file
+        if (menuItem != 7 && load.running){
+            waitForLoad(bottomMenu);
+            numElement = db.numRows;
+            // the journal replayed at the end of the load may have changed the rows on screen
+            printRows(&db, main, NULL, db.numRows, displayableRows, n_attributes, attributesSpacing, index, highlitedRow);
+            paintScreen();
+        }
         // menuItem correspond to each of the functionalites present in the bottom menu
         if (menuItem == 0)
         {
             menuItem = index = highlitedRow = key = 0;
-            cursesPrintSearch(db, main, bottomMenu, attributeRow, 
+            cursesPrintSearch(&db, main, bottomMenu, attributeRow, 
             displayableRows, numElement, n_choices, n_attributes, attributesSpacing, maxX,
             &menuItem, &index, &highlitedRow, &key, choices, attributes);
 
@@ -1351,11 +1643,11 @@ int main ()
         }
         else if (menuItem == 2){
             menuItem = index = highlitedRow = key = 0;
-            cursesAdd(db, main, bottomMenu, attributeRow, 
+            cursesAdd(&db, main, bottomMenu, attributeRow, 
             displayableRows,n_choices, n_attributes, attributesSpacing, maxX,
             &numElement, &menuItem, &index, &highlitedRow, &key, choices, attributes);
         }else if (menuItem == 3){
-            cursesInsert(db, main, bottomMenu, attributeRow, 
+            cursesInsert(&db, main, bottomMenu, attributeRow, 
             displayableRows,n_choices, n_attributes, attributesSpacing, maxX,
             &numElement, &menuItem, &index, &highlitedRow, &key, choices, attributes);
         }else if (menuItem == 4){
@@ -1363,18 +1655,21 @@ int main ()
             displayableRows,n_choices, n_attributes, attributesSpacing, maxX,
             &numElement, &menuItem, &index, &highlitedRow, &key, choices, attributes);
         }else if (menuItem == 5){
-            cursesUpdate(db, main, bottomMenu, attributeRow, 
+            cursesUpdate(&db, main, bottomMenu, attributeRow, 
             displayableRows,n_choices, n_attributes, attributesSpacing, maxX,
             &numElement, &menuItem, &index, &highlitedRow, &key, choices, attributes);
         }else if (menuItem == 6){
             mvwprintw(bottomMenu, 0, 0, "Do you want to save? (Y/N)?");
             char choice = wgetch(bottomMenu);
             if (choice == 'Y' || choice == 'y'){
-                rewind(fp);
-                writeFile(db, fp);
+                // edits are already in the journal, a long journal is saved into the file in the background
+                bool background = commitJournal(&db, &log);
                 wmove(bottomMenu, 0, 0);
                 wclrtoeol(bottomMenu);
-                mvwprintw(bottomMenu, 0, 0, "File has been saved! Press any key to continue");
+                if (background)
+                    mvwprintw(bottomMenu, 0, 0, "Saving in the background! Press any key to continue");
+                else
+                    mvwprintw(bottomMenu, 0, 0, "File has been saved! Press any key to continue");
                 wgetch(bottomMenu);
             }
         }else if (menuItem == 7){
@@ -1382,6 +1677,22 @@ int main ()
         }
     }
     echo();
-    fclose(fp);
+    // quitting while the file loads leaves it as it is, the journal was not opened yet
+    if (load.running){
+        stopLoad(&load);
+        fclose(fp);
+    }else if (commitJournal(&db, &log) || pollSave(&db, &log, false) == SAVE_RUNNING){
+        wmove(bottomMenu, 0, 0);
+        wclrtoeol(bottomMenu);
+        mvwprintw(bottomMenu, 0, 0, "Saving before quitting...");
+        wrefresh(bottomMenu);
+    }
+    closeJournal(&db, &log);
+    freeDB(&db);
+    freeValidators();
     endwin();
+    // Set FLIGHTS_RENDER_STATS to see how fast the table followed the keys
+    if (getenv("FLIGHTS_RENDER_STATS") != NULL)
+        printRenderStats();
+    free(render.lines);
 }
\ No newline at end of file
@@ -0,0 +1,107 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+// Helpers of the randomized checks run by make check, each check is its own program built with the sanitizers
+// Usage of every check: CHECK DATASET SEED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flights.h"
+
+// Stop the check with a message when condition does not hold
+#define expect(condition, ...) do{ \
+    if (!(condition)){ \
+        fprintf(stderr, "Error: " __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+        exit(EXIT_FAILURE); \
+    } \
+}while (0)
+
+static const char *checkCodes[] = {"KUL", "SIN", "BKK", "HND", "PER", "DOH", "CGK", "ZZZ", "QX"};
+#define NUM_CHECK_CODES (int)(sizeof(checkCodes) / sizeof(checkCodes[0]))
+
+// Load a dataset file into an empty db
+void loadDataset(flightDB *db, const char *path){
+    FILE *fp = fopen(path, "r");
+    expect(fp != NULL, "cannot open %s", path);
+    initDB(db);
+    openDB(db, fp, path);
+    fclose(fp);
+}
+
+// The table in display order as the text of a dataset file, to be freed by the caller
+char *tableText(flightDB *db){
+    FILE *fp = tmpfile();
+    expect(fp != NULL, "cannot open a temporary file");
+    writeFile(db, fp);
+    long size = ftell(fp);
+    char *text = (char *)malloc(size + 1);
+    rewind(fp);
+    expect(fread(text, 1, size, fp) == (size_t)size, "cannot read back the table");
+    text[size] = '\0';
+    fclose(fp);
+    return text;
+}
+
+// Whole content of a file, NULL when it does not exist
+char *fileText(const char *path, long *size){
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return NULL;
+    fseek(fp, 0, SEEK_END);
+    *size = ftell(fp);
+    char *text = (char *)malloc(*size + 1);
+    rewind(fp);
+    expect(fread(text, 1, *size, fp) == (size_t)*size, "cannot read %s", path);
+    text[*size] = '\0';
+    fclose(fp);
+    return text;
+}
+
+// A record of the table with a new flight number, flight numbers and codes come from small sets so that they repeat
+// Codes not in the dataset yet, ZZZ and QX, give posting lists that only one side of a route uses
+void randomRecord(flightDB *db, dataSet *record){
+    if (db->numRows > 0){
+        getRecord(db, rowAt(db, rand() % db->numRows), record);
+    }else{
+        memset(record, 0, sizeof(dataSet));
+        strcpy(record->origin, "KUL");
+        strcpy(record->destination, "SIN");
+    }
+    snprintf(record->flightNumber, sizeof(record->flightNumber), "%c%c %d", 'A' + rand() % 4, 'K' - rand() % 3, rand() % 400);
+    if (rand() % 4 == 0)
+        snprintf(record->origin, sizeof(record->origin), "%s", checkCodes[rand() % NUM_CHECK_CODES]);
+    if (rand() % 4 == 0)
+        snprintf(record->destination, sizeof(record->destination), "%s", checkCodes[rand() % NUM_CHECK_CODES]);
+    record->capacity = rand() % 500;
+    record->departureHour = rand() % 24;
+    record->departureMinutes = rand() % 60;
+    record->price = (rand() % 150000) / 100.0f;
+    record->stops = rand() % 4;
+}
+
+// Apply n random adds, inserts, deletes, updates and sorts
+void randomEdits(flightDB *db, int n){
+    dataSet record;
+    for (int i = 0; i < n; i++){
+        int op = rand() % 16;
+        int position = db->numRows > 0 ? rand() % db->numRows : 0;
+        randomRecord(db, &record);
+        if (op < 3){
+            appendDB(db, &record);
+        }else if (op < 7){
+            insertDB(db, rand() % (db->numRows + 1), &record);
+        }else if (op < 11){
+            deleteDB(db, position);
+        }else if (op < 15){
+            updateDB(db, position, &record);
+        }else{
+            sortKey keys[2] = {{1 + rand() % 7, rand() % 2}, {1 + rand() % 7, rand() % 2}};
+            sortDBKeys(db, keys, 1 + rand() % 2);
+        }
+    }
+}
+
+#endif
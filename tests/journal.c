@@ -0,0 +1,175 @@
+#include "check.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// Journal replay against the table a session had when it ended. Sessions run in a child process that edits,
+// sorts and saves in the background, then either closes or exits on the spot, the next open has to give the same table.
+// A torn or damaged tail must be cut, a read-only replay must leave the journal as it is, and a journal of another
+// version of the dataset must be moved aside untouched.
+
+#define ROUNDS 12
+
+static char work[PATH_MAX], journalName[PATH_MAX], expectedName[PATH_MAX];
+
+// Open the working copy and replay its journal, edits are journaled unless readOnly
+void openWork(flightDB *db, journal *log, bool readOnly){
+    FILE *fp = fopen(work, "r+");
+    expect(fp != NULL, "cannot open %s", work);
+    initDB(db);
+    openDB(db, fp, work);
+    replayJournal(db, log, fp, work, readOnly);
+    if (!readOnly)
+        db->log = log;
+}
+
+// One editing session in a child process, the table it ends with is written to expectedName
+// crash leaves without closing the journal, possibly in the middle of a background save
+void session(int numEdits, bool crash){
+    fflush(stdout);
+    pid_t pid = fork();
+    expect(pid >= 0, "cannot fork");
+    if (pid == 0){
+        flightDB db;
+        journal log;
+        openWork(&db, &log, false);
+        for (int done = 0; done < numEdits; done += 50){
+            randomEdits(&db, 50);
+            // saves now and then, with edits landing while the rows are written
+            if (!commitJournal(&db, &log) && rand() % 4 == 0)
+                startSave(&db, &log);
+            pollSave(&db, &log, false);
+        }
+        FILE *out = fopen(expectedName, "w");
+        expect(out != NULL, "cannot write %s", expectedName);
+        writeFile(&db, out);
+        fclose(out);
+        if (crash)
+            _exit(0);
+        closeJournal(&db, &log);
+        freeDB(&db);
+        exit(0);
+    }
+    int status;
+    expect(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0, "session failed");
+}
+
+// Open the working copy and compare the table with what the last session ended with
+void verify(const char *what, bool readOnly){
+    flightDB db;
+    journal log;
+    long size;
+    openWork(&db, &log, readOnly);
+    char *table = tableText(&db), *expected = fileText(expectedName, &size);
+    expect(expected != NULL && strcmp(table, expected) == 0, "%s: the replayed table is not the one the session ended with", what);
+    expect(!readOnly || log.fp == NULL, "%s: a read-only replay kept the journal open", what);
+    free(table);
+    free(expected);
+    closeJournal(&db, &log);
+    freeDB(&db);
+}
+
+// Append text to the journal and return its size before
+long appendJournal(const char *text){
+    long size;
+    free(fileText(journalName, &size));
+    FILE *fp = fopen(journalName, "a");
+    expect(fp != NULL, "cannot open %s", journalName);
+    fputs(text, fp);
+    fclose(fp);
+    return size;
+}
+
+void copyFile(const char *from, const char *to){
+    long size;
+    char *text = fileText(from, &size);
+    expect(text != NULL, "cannot read %s", from);
+    FILE *fp = fopen(to, "w");
+    expect(fp != NULL && fwrite(text, 1, size, fp) == (size_t)size, "cannot write %s", to);
+    fclose(fp);
+    free(text);
+}
+
+// Remove the working copy and everything saved next to it
+void removeWork(void){
+    static const char *suffixes[] = {"", JOURNAL_SUFFIX, JOURNAL_SUFFIX ".next", JOURNAL_SUFFIX ".stale", JOURNAL_SUFFIX ".stale.1",
+                                     SNAPSHOT_SUFFIX, ".save", SNAPSHOT_SUFFIX ".save", SNAPSHOT_SUFFIX ".tmp", ".expected"};
+    char name[PATH_MAX + 32];
+    for (int i = 0; i < (int)(sizeof(suffixes) / sizeof(suffixes[0])); i++){
+        snprintf(name, sizeof(name), "%s%s", work, suffixes[i]);
+        unlink(name);
+    }
+}
+
+int main(int argc, char *argv[]){
+    if (argc < 3){
+        fprintf(stderr, "Usage: %s DATASET SEED\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    expect(snprintf(work, sizeof(work), "%s.work", argv[1]) < (int)sizeof(work) &&
+           snprintf(journalName, sizeof(journalName), "%s%s", work, JOURNAL_SUFFIX) < (int)sizeof(journalName) &&
+           snprintf(expectedName, sizeof(expectedName), "%s.expected", work) < (int)sizeof(expectedName), "path too long");
+    removeWork();
+    copyFile(argv[1], work);
+    srand(atoi(argv[2]));
+
+    for (int round = 0; round < ROUNDS; round++){
+        bool crash = round % 2 == 0;
+        session(200 + rand() % 400, crash);
+        verify(crash ? "unclean exit" : "close", false);
+    }
+
+    // a record cut short by a crash, then a damaged one, are dropped with everything after them
+    session(300, true);
+    long size = appendJournal("U 3 AK 1,KUL,SI");
+    verify("torn tail", false);
+    long after;
+    free(fileText(journalName, &after));
+    expect(after == size, "torn tail: the journal is %ld bytes, it should be cut to %ld", after, size);
+    size = appendJournal("X 1\nD 0\n");
+    verify("damaged record", false);
+    free(fileText(journalName, &after));
+    expect(after == size, "damaged record: the journal is %ld bytes, it should be cut to %ld", after, size);
+
+    // a read-only replay, as a batch run does, leaves the journal byte for byte
+    session(300, true);
+    appendJournal("U 3 AK");
+    long before;
+    char *journalBefore = fileText(journalName, &before);
+    verify("read-only replay", true);
+    char *journalAfter = fileText(journalName, &after);
+    expect(journalAfter != NULL && after == before && memcmp(journalBefore, journalAfter, before) == 0, "read-only replay changed the journal");
+    free(journalAfter);
+
+    // touching the dataset makes the journal one of another version, it is not replayed and is kept aside
+    struct timespec times[2] = {{0, UTIME_OMIT}, {time(NULL) + 5, 0}};
+    expect(utimensat(AT_FDCWD, work, times, 0) == 0, "cannot touch %s", work);
+    flightDB db;
+    FILE *fp = fopen(work, "r");
+    initDB(&db);
+    loadFile(fp, &db);
+    fclose(fp);
+    char *text = tableText(&db);
+    freeDB(&db);
+    FILE *out = fopen(expectedName, "w");
+    fputs(text, out);
+    fclose(out);
+    free(text);
+    verify("stale journal, read-only", true);
+    journalAfter = fileText(journalName, &after);
+    expect(journalAfter != NULL && after == before && memcmp(journalBefore, journalAfter, before) == 0, "read-only replay changed a stale journal");
+    free(journalAfter);
+    verify("stale journal", false);
+    char stale[PATH_MAX + 16];
+    snprintf(stale, sizeof(stale), "%s.stale", journalName);
+    journalAfter = fileText(stale, &after);
+    expect(journalAfter != NULL && after == before && memcmp(journalBefore, journalAfter, before) == 0, "the stale journal was not kept as it was");
+    free(journalAfter);
+    free(journalBefore);
+
+    removeWork();
+    printf("journal: ok, %d sessions\n", ROUNDS + 3);
+    return 0;
+}
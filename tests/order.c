@@ -0,0 +1,121 @@
+#include "check.h"
+
+// The display order B+-tree against a plain array of rows under random inserts, deletes, updates and sorts
+// After every batch of edits the tree is walked to check its counts, parent and leaf links and leafOf
+
+#define ROUNDS 40
+
+// Check the subtree below node, return the number of rows in it and append its leaves in order to leaves
+int checkNode(flightDB *db, orderNode *node, orderNode *parent, orderNode *leaves[], int *numLeaves){
+    expect(node->parent == parent, "node with a wrong parent");
+    if (node->leaf){
+        expect(node->numItems == node->count, "leaf counts %d rows and holds %d", node->count, node->numItems);
+        expect(node->numItems > 0 || parent == NULL, "empty leaf below the root");
+        for (int i = 0; i < node->numItems; i++)
+            expect(db->leafOf[node->rows[i]] == node, "leafOf of row %d is not its leaf", node->rows[i]);
+        leaves[(*numLeaves)++] = node;
+        return node->count;
+    }
+    expect(node->numItems > 0 && node->numItems <= ORDER_FANOUT, "inner node with %d children", node->numItems);
+    int count = 0;
+    for (int c = 0; c < node->numItems; c++)
+        count += checkNode(db, node->children[c], node, leaves, numLeaves);
+    expect(count == node->count, "inner node counts %d rows and holds %d", node->count, count);
+    return count;
+}
+
+// Compare the whole tree with the rows the model expects at every position
+void checkTree(flightDB *db, int model[], int numRows){
+    orderTree *tree = &db->order;
+    expect(db->numRows == numRows, "%d rows listed, the model has %d", db->numRows, numRows);
+    if (tree->root == NULL){
+        expect(numRows == 0, "no tree for %d rows", numRows);
+        return;
+    }
+    orderNode **leaves = (orderNode **)malloc((numRows + 1) * sizeof(orderNode *));
+    int numLeaves = 0;
+    expect(checkNode(db, tree->root, NULL, leaves, &numLeaves) == numRows, "root does not count every row");
+    for (int i = 0; i < numLeaves; i++){
+        expect(leaves[i]->prev == (i > 0 ? leaves[i - 1] : NULL), "leaf %d has a wrong prev link", i);
+        expect(leaves[i]->next == (i + 1 < numLeaves ? leaves[i + 1] : NULL), "leaf %d has a wrong next link", i);
+    }
+    free(leaves);
+
+    int *rows = (int *)malloc((numRows > 0 ? numRows : 1) * sizeof(int));
+    orderRows(db, rows);
+    for (int i = 0; i < numRows; i++){
+        expect(rows[i] == model[i], "position %d holds row %d, the model has %d", i, rows[i], model[i]);
+        expect(positionOf(db, model[i]) == i, "positionOf row %d is not %d", model[i], i);
+    }
+    free(rows);
+}
+
+int main(int argc, char *argv[]){
+    if (argc < 3){
+        fprintf(stderr, "Usage: %s DATASET SEED\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    flightDB db;
+    loadDataset(&db, argv[1]);
+    srand(atoi(argv[2]));
+
+    int capacity = db.numRows + 100000;
+    int *model = (int *)malloc(capacity * sizeof(int));
+    orderRows(&db, model);
+    int numRows = db.numRows;
+    checkTree(&db, model, numRows);
+
+    dataSet record;
+    for (int round = 0; round < ROUNDS; round++){
+        for (int i = 0; i < 1000; i++){
+            int op = rand() % 10;
+            int position = rand() % (numRows + 1);
+            randomRecord(&db, &record);
+            // runs of inserts and deletes at one end split and merge whole leaves
+            if (round % 10 == 9)
+                position = op < 5 ? numRows : numRows - 1;
+            if (op < 5 && numRows < capacity){
+                insertDB(&db, position, &record);
+                memmove(model + position + 1, model + position, (numRows - position) * sizeof(int));
+                model[position] = rowAt(&db, position);
+                numRows++;
+                expect(strcmp(db.flightNumber[model[position]], record.flightNumber) == 0, "insert at %d is not listed there", position);
+            }else if (op < 9 && numRows > 0){
+                position = position < numRows ? position : numRows - 1;
+                deleteDB(&db, position);
+                memmove(model + position, model + position + 1, (numRows - position - 1) * sizeof(int));
+                numRows--;
+            }else if (numRows > 0){
+                position = position < numRows ? position : numRows - 1;
+                updateDB(&db, position, &record);
+                model[position] = rowAt(&db, position);
+                expect(strcmp(db.flightNumber[model[position]], record.flightNumber) == 0, "update at %d is not listed there", position);
+            }
+            if (numRows > 0){
+                int probe = rand() % numRows;
+                expect(rowAt(&db, probe) == model[probe], "rowAt %d differs from the model", probe);
+            }
+        }
+        // a sort rebuilds the tree, the model takes the order it gives
+        if (round % 8 == 7){
+            sortDB(&db, 1 + rand() % 7);
+            orderRows(&db, model);
+        }
+        checkTree(&db, model, numRows);
+    }
+    // deleting every row leaves an empty tree that takes rows again
+    while (numRows > 0){
+        deleteDB(&db, rand() % numRows);
+        numRows--;
+    }
+    checkTree(&db, model, 0);
+    randomRecord(&db, &record);
+    insertDB(&db, 0, &record);
+    model[0] = rowAt(&db, 0);
+    checkTree(&db, model, 1);
+
+    printf("order: ok, %d rounds of edits\n", ROUNDS);
+    free(model);
+    freeDB(&db);
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include "check.h"
+
+// The search indexes against a scan of every row under random edits: substring search through the trigram index
+// and the route index, narrowing a result as the input grows, exact flight numbers and exact routes
+
+#define ROUNDS 60
+
+static int *order, numOrder;
+
+// Text of a string attribute of a row, option 1: Flight Number, 2: Origin, 3: Destination
+const char *rowText(flightDB *db, int row, int option, char code[5]){
+    if (option == 1)
+        return db->flightNumber[row];
+    unpackCode(option == 2 ? db->origin[row] : db->destination[row], code);
+    return code;
+}
+
+// Compare a result with the rows in display order for which matches holds
+void checkResult(flightDB *db, searchResult *result, const char *what, bool (*matches)(flightDB *, int, const void *), const void *argument){
+    int n = 0;
+    for (int i = 0; i < numOrder; i++){
+        if (!matches(db, order[i], argument))
+            continue;
+        expect(n < result->numRows && result->rows[n] == order[i], "%s misses row %d or lists it out of order", what, order[i]);
+        n++;
+    }
+    expect(n == result->numRows, "%s lists %d rows, a scan finds %d", what, result->numRows, n);
+}
+
+typedef struct textQuery{
+    int option;
+    const char *text;
+}textQuery;
+
+bool containsText(flightDB *db, int row, const void *argument){
+    const textQuery *q = (const textQuery *)argument;
+    char code[5];
+    return strstr(rowText(db, row, q->option, code), q->text) != NULL;
+}
+
+bool sameFlight(flightDB *db, int row, const void *argument){
+    return strcmp(db->flightNumber[row], (const char *)argument) == 0;
+}
+
+bool sameRoute(flightDB *db, int row, const void *argument){
+    const unsigned int *codes = (const unsigned int *)argument;
+    return db->origin[row] == codes[0] && (codes[1] == 0 || db->destination[row] == codes[1]);
+}
+
+// Search every substring of text, and narrow the result of each prefix down to the next one
+void checkText(flightDB *db, int option, const char *text){
+    int length = strlen(text);
+    char input[20], what[64];
+    searchResult result = {0}, narrowed = {0};
+    for (int start = 0; start < length; start++){
+        for (int end = start + 1; end <= length; end++){
+            snprintf(input, sizeof(input), "%.*s", end - start, text + start);
+            textQuery q = {option, input};
+            snprintf(what, sizeof(what), "search %d \"%s\"", option, input);
+            searchDB(db, input, &result, option);
+            checkResult(db, &result, what, containsText, &q);
+            if (end < length){
+                char longer[20];
+                snprintf(longer, sizeof(longer), "%.*s", end - start + 1, text + start);
+                textQuery next = {option, longer};
+                snprintf(what, sizeof(what), "narrow %d \"%s\"", option, longer);
+                narrowSearch(db, &result, longer, &narrowed, option);
+                checkResult(db, &narrowed, what, containsText, &next);
+            }
+        }
+    }
+    releaseSearch(db, &result);
+    releaseSearch(db, &narrowed);
+}
+
+int main(int argc, char *argv[]){
+    if (argc < 3){
+        fprintf(stderr, "Usage: %s DATASET SEED\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    flightDB db;
+    loadDataset(&db, argv[1]);
+    srand(atoi(argv[2]));
+    static const char *missing[] = {"X", "K 9999", "ZZ", "Q", "QX", "AK 1", "1 1", "99"};
+    int numMissing = sizeof(missing) / sizeof(missing[0]);
+
+    for (int round = 0; round < ROUNDS; round++){
+        randomEdits(&db, 500);
+        order = (int *)realloc(order, (db.numRows > 0 ? db.numRows : 1) * sizeof(int));
+        orderRows(&db, order);
+        numOrder = db.numRows;
+        if (numOrder == 0)
+            continue;
+
+        int row = order[rand() % numOrder];
+        char code[5];
+        for (int option = 1; option <= 3; option++)
+            checkText(&db, option, rowText(&db, row, option, code));
+        checkText(&db, 1 + rand() % 3, missing[rand() % numMissing]);
+
+        searchResult result = {0};
+        char what[64], flight[20];
+        snprintf(flight, sizeof(flight), "%s", round % 5 == 4 ? "QZ 1" : db.flightNumber[row]);
+        snprintf(what, sizeof(what), "exact \"%s\"", flight);
+        searchExactDB(&db, flight, &result);
+        checkResult(&db, &result, what, sameFlight, flight);
+
+        // a whole route, then every flight leaving the origin, then to one of the codes of the check, some of which no row leaves from
+        char origin[5], destination[5];
+        unpackCode(db.origin[row], origin);
+        unpackCode(db.destination[row], destination);
+        for (int i = 0; i < 3; i++){
+            const char *to = i == 0 ? destination : (i == 1 ? "" : checkCodes[rand() % NUM_CHECK_CODES]);
+            unsigned int codes[2] = {packCode(origin), to[0] != '\0' ? packCode(to) : 0};
+            snprintf(what, sizeof(what), "route \"%s %s\"", origin, to);
+            searchRouteDB(&db, origin, (char *)to, &result);
+            checkResult(&db, &result, what, sameRoute, codes);
+        }
+        releaseSearch(&db, &result);
+    }
+    printf("search: ok, %d rounds of edits\n", ROUNDS);
+    free(order);
+    freeDB(&db);
+    return 0;
+}